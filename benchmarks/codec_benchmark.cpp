@@ -0,0 +1,186 @@
+/*
+codec_benchmark.cpp
+Measures how fast each image format is written and read back, and how big the files are.
+
+Build and run from the repository root:
+    g++ -std=c++11 -O2 -pthread -o codec_benchmark benchmarks/codec_benchmark.cpp
+    ./codec_benchmark [input image] [repeats]
+
+The input image (sample.bmp by default) is tested as it is and after process 3 (grayscale,
+up to 256 grays), process 7 (two colors) and process 10 (five colors), since the paletted and
+compressed layouts depend on how many colors an image uses. Every format the program writes is
+tested: the four BMP layouts on their own, then each codec in get_codecs() as chosen by the
+output file's extension (the BMP codec picks the smallest layout that holds the image exactly).
+Writes go to the page cache and reads come from it, so the times are the cost of encoding and
+decoding rather than of the disk. "Exact" says whether reading the file back gives the image
+that was written; PGM and PBM keep only the gray values.
+*/
+
+#define IMAGE_MANIPULATOR_NO_MAIN
+#include "../mcafee_main.cpp"
+
+// helper function to write a BMP in one paletted layout
+// @return false if the image uses more colors than the layout can hold
+bool write_bmp_layout(string filename, const vector<vector<Pixel>> &image, int bits_per_pixel, int compression)
+{
+    vector<Pixel> palette;
+    vector<vector<unsigned char>> indices;
+    if (!get_image_palette(image, 1 << bits_per_pixel, palette, indices))
+    {
+        return false;
+    }
+    vector<unsigned char> pixel_array;
+    if (compression == BI_RLE8)
+    {
+        pixel_array = encode_bmp_rle8(indices);
+    }
+    else
+    {
+        pixel_array = pack_bmp_rows(indices, bits_per_pixel);
+    }
+    return write_bmp_paletted(filename, image[0].size(), image.size(), bits_per_pixel, compression, palette,
+                              pixel_array);
+}
+
+bool write_bmp_24bit(string filename, const vector<vector<Pixel>> &image, int num_threads)
+{
+    return write_image_parallel(filename, image, num_threads);
+}
+
+bool write_bmp_8bit(string filename, const vector<vector<Pixel>> &image, int)
+{
+    return write_bmp_layout(filename, image, 8, BI_RGB);
+}
+
+bool write_bmp_rle8(string filename, const vector<vector<Pixel>> &image, int)
+{
+    return write_bmp_layout(filename, image, 8, BI_RLE8);
+}
+
+bool write_bmp_1bit(string filename, const vector<vector<Pixel>> &image, int)
+{
+    return write_bmp_layout(filename, image, 1, BI_RGB);
+}
+
+// One way of saving an image
+struct Layout
+{
+    string name;
+    string extension;
+    bool (*write)(string filename, const vector<vector<Pixel>> &image, int num_threads);
+};
+
+// helper function to get the size of a file in bytes
+long long get_file_bytes(string filename)
+{
+    fstream stream;
+    stream.open(filename, ios::in | ios::binary);
+    if (!stream.is_open())
+    {
+        return -1;
+    }
+    return get_file_size(stream);
+}
+
+// helper function to check that two images hold the same pixels (as the bytes they are saved as)
+bool same_image(const vector<vector<Pixel>> &a, const vector<vector<Pixel>> &b)
+{
+    if (a.size() != b.size() || a.empty() || a[0].size() != b[0].size())
+    {
+        return false;
+    }
+    for (size_t row = 0; row < a.size(); row++)
+    {
+        for (size_t column = 0; column < a[0].size(); column++)
+        {
+            const Pixel &p = a[row][column];
+            const Pixel &q = b[row][column];
+            if ((unsigned char)p.red != (unsigned char)q.red || (unsigned char)p.green != (unsigned char)q.green ||
+                (unsigned char)p.blue != (unsigned char)q.blue)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// helper function to get the median of some timings
+double median(vector<double> values)
+{
+    sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char *argv[])
+{
+    string input_filename = argc > 1 ? argv[1] : "sample.bmp";
+    int repeats = argc > 2 ? atoi(argv[2]) : 5;
+
+    vector<vector<Pixel>> image = read_image_file(input_filename);
+    if (image.empty() || repeats < 1)
+    {
+        cout << "Usage: codec_benchmark [input image] [repeats]" << endl;
+        return 1;
+    }
+
+    vector<string> image_names = {"original", "process 3", "process 7", "process 10"};
+    vector<vector<vector<Pixel>>> images = {image, process_3(image), process_7(image), process_10(image)};
+
+    vector<Layout> layouts = {
+        {"BMP 24 bit", ".bmp", write_bmp_24bit},
+        {"BMP 8 bit", ".bmp", write_bmp_8bit},
+        {"BMP RLE8", ".bmp", write_bmp_rle8},
+        {"BMP 1 bit", ".bmp", write_bmp_1bit},
+    };
+    const vector<Codec> &codecs = get_codecs();
+    for (size_t i = 0; i < codecs.size(); i++)
+    {
+        layouts.push_back({codecs[i].name + (i == 0 ? " (smallest)" : ""), codecs[i].extension, codecs[i].write});
+    }
+
+    cout << image[0].size() << " x " << image.size() << " image, median of " << repeats << " runs" << endl;
+    cout << left << setw(12) << "Image" << setw(18) << "Format" << right << setw(10) << "Bytes" << setw(8)
+         << "Ratio" << setw(12) << "Write (ms)" << setw(11) << "Read (ms)" << setw(7) << "Exact" << endl;
+    cout << fixed;
+
+    for (size_t n = 0; n < images.size(); n++)
+    {
+        long long baseline_bytes = 0;
+        for (size_t l = 0; l < layouts.size(); l++)
+        {
+            string filename = "codec_benchmark" + layouts[l].extension;
+            vector<double> write_times, read_times;
+            bool written = true;
+            vector<vector<Pixel>> read_back;
+            for (int r = 0; r < repeats && written; r++)
+            {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                written = layouts[l].write(filename, images[n], 1);
+                write_times.push_back(elapsed_ns(start, chrono::steady_clock::now()) / 1e6);
+
+                start = chrono::steady_clock::now();
+                read_back = read_image_file(filename);
+                read_times.push_back(elapsed_ns(start, chrono::steady_clock::now()) / 1e6);
+            }
+
+            cout << left << setw(12) << image_names[n] << setw(18) << layouts[l].name << right;
+            if (!written)
+            {
+                // The image has too many colors for this layout
+                cout << setw(10) << "n/a" << endl;
+                continue;
+            }
+            long long bytes = get_file_bytes(filename);
+            if (l == 0)
+            {
+                baseline_bytes = bytes;
+            }
+            cout << setw(10) << bytes << setw(8) << setprecision(2) << (double)baseline_bytes / bytes << setw(12)
+                 << setprecision(2) << median(write_times) << setw(11) << median(read_times) << setw(7)
+                 << (same_image(images[n], read_back) ? "yes" : "no") << endl;
+            remove(filename.c_str());
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+io_benchmark.cpp
+Measures BMP read and write throughput of read_image_parallel and write_image_parallel
+for a range of thread counts.
+
+Build and run from the repository root:
+    g++ -std=c++11 -O2 -pthread -o io_benchmark benchmarks/io_benchmark.cpp
+    ./io_benchmark [input BMP] [enlarge factor] [max threads] [repeats]
+
+The input image (sample.bmp by default) is enlarged with process 6 so the pixel array is
+big enough to split (factor 8 turns sample.bmp into a 36 MB file). Warm cache reads read
+the file straight after it was written. Cold cache reads first ask the operating system to
+drop the file from its page cache (Linux only). Writes go to the page cache and include
+an fsync, so they measure the time until the data is on disk.
+*/
+
+#define IMAGE_MANIPULATOR_NO_MAIN
+#include "../mcafee_main.cpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// helper function to flush a file to disk and drop it from the page cache
+// @return true if the cache could be dropped
+bool drop_file_cache(string filename)
+{
+#ifdef __linux__
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    fsync(fd);
+    bool dropped = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return dropped;
+#else
+    return false;
+#endif
+}
+
+// helper function to flush a file to disk
+void sync_file(string filename)
+{
+#ifdef __linux__
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+#endif
+}
+
+// helper function to get the median of some timings
+double median(vector<double> values)
+{
+    sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char *argv[])
+{
+    string input_filename = argc > 1 ? argv[1] : "sample.bmp";
+    int factor = argc > 2 ? atoi(argv[2]) : 8;
+    int max_threads = argc > 3 ? atoi(argv[3]) : max(8, (int)thread::hardware_concurrency());
+    int repeats = argc > 4 ? atoi(argv[4]) : 5;
+    string filename = "io_benchmark.bmp";
+
+    vector<vector<Pixel>> image = read_image_file(input_filename);
+    if (image.empty() || factor < 1 || max_threads < 1 || repeats < 1)
+    {
+        cout << "Usage: io_benchmark [input BMP] [enlarge factor] [max threads] [repeats]" << endl;
+        return 1;
+    }
+    image = process_6(image, factor, factor);
+    int width = image[0].size();
+    int height = image.size();
+    double megabytes = (54.0 + (width * 3 + (4 - width * 3 % 4) % 4) * (double)height) / 1e6;
+    bool can_drop_cache = write_image_parallel(filename, image, 1) && drop_file_cache(filename);
+
+    cout << width << " x " << height << " image, " << fixed << setprecision(1) << megabytes << " MB, "
+         << thread::hardware_concurrency() << " hardware threads, median of " << repeats << " runs" << endl;
+    cout << right << setw(8) << "Threads" << setw(18) << "Warm read (MB/s)" << setw(18) << "Cold read (MB/s)"
+         << setw(14) << "Write (MB/s)" << endl;
+
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        vector<double> warm_times, cold_times, write_times;
+        for (int r = 0; r < repeats; r++)
+        {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            bool written = write_image_parallel(filename, image, threads);
+            sync_file(filename);
+            write_times.push_back(elapsed_ns(start, chrono::steady_clock::now()) / 1e9);
+
+            start = chrono::steady_clock::now();
+            bool warm_ok = !read_image_parallel(filename, threads).empty();
+            warm_times.push_back(elapsed_ns(start, chrono::steady_clock::now()) / 1e9);
+
+            if (can_drop_cache)
+            {
+                drop_file_cache(filename);
+                start = chrono::steady_clock::now();
+                read_image_parallel(filename, threads);
+                cold_times.push_back(elapsed_ns(start, chrono::steady_clock::now()) / 1e9);
+            }
+
+            if (!written || !warm_ok)
+            {
+                cout << "Could not write or read " << filename << endl;
+                return 1;
+            }
+        }
+
+        cout << setw(8) << threads << setw(18) << megabytes / median(warm_times) << setw(18);
+        if (can_drop_cache)
+        {
+            cout << megabytes / median(cold_times);
+        }
+        else
+        {
+            cout << "n/a";
+        }
+        cout << setw(14) << megabytes / median(write_times) << endl;
+    }
+
+    remove(filename.c_str());
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+fuzz_image_parsers.cpp
+libFuzzer harness for the image file parsers. Each input is checked by parse_bmp_header
+straight from memory, then written to a temporary file and read back with read_image_file,
+which runs the BMP, PPM/PGM/PBM or QOI reader picked by the file's first bytes.
+
+Build and run from the repository root (needs clang):
+    clang++ -std=c++11 -g -O1 -fsanitize=fuzzer,address,undefined -pthread -o fuzz_image fuzz/fuzz_image_parsers.cpp
+    ./fuzz_image fuzz/corpus
+
+fuzz/corpus holds small seed images cut from the pictures in sample_images/ and saved in every
+format and BMP variant the program writes (24 bit, 8 bit, RLE8 and 1 bit BMP, PPM, PGM, PBM and
+QOI), plus a 32 bit BI_BITFIELDS BMP with its channels in red, green, blue order. New inputs
+that reach new code are added to it.
+*/
+
+#define IMAGE_MANIPULATOR_NO_MAIN
+#include "../mcafee_main.cpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+
+// Temporary file for this fuzzing process, so several fuzzing jobs can run side by side
+string fuzz_filename;
+
+// helper function to delete the temporary file when the fuzzer exits
+void remove_fuzz_file()
+{
+    remove(fuzz_filename.c_str());
+}
+
+// helper function to create the temporary file the first time it is needed
+// @return the file name, or an empty string if it could not be created
+string get_fuzz_filename()
+{
+    if (fuzz_filename.empty())
+    {
+        char path[] = "/tmp/fuzz_image_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd >= 0)
+        {
+            close(fd);
+            fuzz_filename = path;
+            atexit(remove_fuzz_file);
+        }
+    }
+    return fuzz_filename;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    // The BMP header checks run on the bytes as they are, with the real size and a size the
+    // header may claim, so both the in-memory and the file size checks are exercised
+    BmpInfo info;
+    parse_bmp_header(data, size, size, info);
+    if (size >= BMP_HEADER_SIZE + DIB_HEADER_SIZE)
+    {
+        parse_bmp_header(data, size, get_le(data, 2, 4), info);
+    }
+
+    string filename = get_fuzz_filename();
+    if (filename.empty())
+    {
+        return 0;
+    }
+    {
+        ofstream stream(filename, ios::out | ios::binary | ios::trunc);
+        stream.write((const char *)data, size);
+    }
+
+    vector<vector<Pixel>> image = read_image_file(filename);
+    if (!image.empty())
+    {
+        // Every reader must return a rectangular image within the size caps
+        size_t width = image[0].size();
+        if (!check_image_size(width, image.size()))
+        {
+            abort();
+        }
+        for (size_t row = 0; row < image.size(); row++)
+        {
+            if (image[row].size() != width)
+            {
+                abort();
+            }
+        }
+    }
+    return 0;
+}
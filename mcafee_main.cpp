@@ -22,6 +22,20 @@ PLEASE FILL OUT THIS SECTION PRIOR TO SUBMISSION
 #include <fstream>
 #include <cmath>
 #include <cstring>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <set>
+#include <cctype>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <condition_variable>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -234,386 +248,2810 @@ bool write_image(string filename, const vector<vector<Pixel>> &image)
 //***************************************************************************************************//
 //                                DO NOT MODIFY THE SECTION ABOVE                                    //
 //***************************************************************************************************//
-// helper function to prompt user to enter an output filename
-string get_output_filename()
+
+// BMP files start with a 14 byte BMP header followed by a 40 byte DIB header
+const int BMP_HEADER_SIZE = 14;
+const int DIB_HEADER_SIZE = 40;
+
+// Each row-range thread should have at least this many bytes of pixel data to move,
+// otherwise starting the thread costs more than it saves
+const long long MIN_BYTES_PER_IO_THREAD = 1 << 20;
+
+// Rows are read/written in blocks of this many rows so each thread only buffers a slice of the file
+const int IO_BLOCK_ROWS = 64;
+
+// helper function to pick how many threads to use for reading/writing a BMP pixel array
+// Reads and writes use one thread unless the caller asks for more. On the only machine measured
+// so far (one core, see benchmarks/io_benchmark.cpp) 2 and 4 threads were slower than 1
+// @param height            number of rows in the pixel array
+// @param row_bytes         size of one row in the file, including padding
+// @param requested_threads number of threads to use, or 0 to choose from the image size
+// @return the number of threads, between 1 and the number of rows
+int get_io_thread_count(int height, int row_bytes, int requested_threads)
 {
-    string filename;
-    cout << "Please select an output filename for your altered image. Please do not use the input filename as it will be overwritten.";
-    cout << endl;
-    cin >> filename;
-    return filename;
+    long long thread_count = requested_threads;
+    if (requested_threads <= 0)
+    {
+        long long total_bytes = (long long)height * row_bytes;
+        long long hardware_threads = thread::hardware_concurrency();
+        if (hardware_threads < 1)
+        {
+            hardware_threads = 1;
+        }
+        thread_count = min(total_bytes / MIN_BYTES_PER_IO_THREAD, hardware_threads);
+    }
+    thread_count = min(thread_count, (long long)height);
+    if (thread_count < 1)
+    {
+        thread_count = 1;
+    }
+    return thread_count;
 }
-// helper function to print menu of filter options and prompt user for a selection
-// @return the user selection used to determine image processor
-int get_selection()
+
+// Largest width or height accepted from an image file, and largest number of pixels.
+// A Pixel takes 12 bytes in memory, so the pixel cap (4096 x 4096) keeps one image under about 200 MB
+const int MAX_IMAGE_DIMENSION = 1 << 16;
+const long long MAX_IMAGE_PIXELS = 1 << 24;
+
+// helper function to check image dimensions read from a file before anything is allocated for them
+// @return true if the width and height are positive and within the caps
+bool check_image_size(long long width, long long height)
 {
-    string selection;
-    int selection_to_int;
-    cout << "Please select a filter/option from the list below.\n";
-    cout << "0: Change file selection\n1: Adds Vignette \n2: Adds Clarendon \n3: Grayscale \n4: Rotates 90 Degrees \n5: Rotates (Multiples of 90 Degrees)\n6: Enlarges image in x and y direction (integer values only)\n7: Converts image to high contrast (black and white only)\n8: Lightens image by a scaling factor (integer values only)\n9: Darkens image by a scaling factor (integer values only)\n10: Converts image to only black, white, red, blue, and green\n";
-    cout << "(Enter Q to quit.)\n";
-    cin >> selection;
-    if (selection == "Q" || selection == "q")
+    return width > 0 && height > 0 && width <= MAX_IMAGE_DIMENSION && height <= MAX_IMAGE_DIMENSION &&
+           width * height <= MAX_IMAGE_PIXELS;
+}
+
+// helper function to get the size of an open file in bytes
+// @return the size, or -1 if it cannot be determined
+long long get_file_size(fstream &stream)
+{
+    stream.seekg(0, ios::end);
+    long long size = stream.tellg();
+    stream.seekg(0);
+    return size;
+}
+
+// BMP compression methods
+const int BI_RGB = 0;
+const int BI_RLE8 = 1;
+const int BI_BITFIELDS = 3;
+
+// A BI_BITFIELDS image has red, green and blue masks of 4 bytes each straight after the
+// 40 byte DIB header (later header versions include them in the header at the same place)
+const int BITFIELDS_MASKS_SIZE = 12;
+
+// Image properties read from the BMP and DIB headers
+struct BmpInfo
+{
+    int start;
+    int dib_size;
+    int width;
+    int height;
+    int bits_per_pixel;
+    int compression;
+    int palette_colors; // Number of palette entries actually stored (0 for 24 and 32 bit images)
+    int row_stride;     // Size of one uncompressed row in the file, including padding
+    long long file_size;
+    int red_byte;       // Position of each channel's byte within a 24 or 32 bit pixel
+    int green_byte;
+    int blue_byte;
+};
+
+// helper function to read a little endian integer from a byte array
+// Helper function for parse_bmp_header()
+long long get_le(const unsigned char data[], int offset, int bytes)
+{
+    long long result = 0;
+    for (int i = bytes - 1; i >= 0; i--)
     {
-        cout << "Thank you for using the CSPB1330 image manipulator. Have a great day!\n";
-        selection_to_int = -1;
-        return selection_to_int;
+        result = result * 256 + data[offset + i];
     }
-    try
+    return result;
+}
+
+// helper function to find which byte of a 32 bit pixel a BI_BITFIELDS channel mask selects
+// Helper function for parse_bmp_header()
+// @return 0 to 3, or -1 if the mask is not exactly one whole byte
+int get_mask_byte(long long mask)
+{
+    for (int i = 0; i < 4; i++)
     {
-        selection_to_int = stoi(selection);
+        if (mask == 0xFFLL << (8 * i))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Parses and checks the BMP and DIB headers held in memory.
+// All size math is done in 64 bits and checked against the caps and the real file size,
+// so a malformed file is rejected before anything is allocated for it
+// @param header    the first bytes of the file (BMP_HEADER_SIZE + DIB_HEADER_SIZE, plus
+//                  BITFIELDS_MASKS_SIZE for BI_BITFIELDS images)
+// @param size      number of bytes in header
+// @param file_size the real size of the file in bytes
+// @param info      filled in with the image properties
+// @return true if the headers describe an image this program can read
+bool parse_bmp_header(const unsigned char header[], long long size, long long file_size, BmpInfo &info)
+{
+    if (size < BMP_HEADER_SIZE + DIB_HEADER_SIZE || header[0] != 'B' || header[1] != 'M')
+    {
+        return false;
     }
-    catch (invalid_argument user_input)
+    long long start = get_le(header, 10, 4);
+    long long dib_size = get_le(header, 14, 4);
+    long long width = get_le(header, 18, 4);
+    long long height = get_le(header, 22, 4);
+    long long bits_per_pixel = get_le(header, 28, 2);
+    long long compression = get_le(header, 30, 4);
+    long long palette_colors = get_le(header, 46, 4);
+
+    // Negative heights (top to bottom images) are not supported, so width and height
+    // above 2^31 are rejected by the size caps
+    if (!check_image_size(width, height))
     {
-        cout << selection;
-        cout << " is not a valid selection. Please try again\n";
-        selection_to_int = -2;
+        return false;
     }
-    return selection_to_int;
+    if (dib_size < DIB_HEADER_SIZE || start < BMP_HEADER_SIZE + dib_size || start > file_size)
+    {
+        return false;
+    }
+
+    bool paletted = bits_per_pixel == 1 || bits_per_pixel == 4 || bits_per_pixel == 8;
+    bool valid_format = (compression == BI_RGB && (paletted || bits_per_pixel == 24 || bits_per_pixel == 32)) ||
+                        (compression == BI_RLE8 && bits_per_pixel == 8) ||
+                        (compression == BI_BITFIELDS && bits_per_pixel == 32);
+    if (!valid_format)
+    {
+        return false;
+    }
+
+    // A palette size of 0 means every possible color is listed
+    if (!paletted)
+    {
+        palette_colors = 0;
+    }
+    else if (palette_colors == 0)
+    {
+        palette_colors = 1LL << bits_per_pixel;
+    }
+    if (palette_colors > (1LL << bits_per_pixel) || BMP_HEADER_SIZE + dib_size + palette_colors * 4 > start)
+    {
+        return false;
+    }
+
+    // Channels are stored blue, green, red unless BI_BITFIELDS masks say otherwise.
+    // Only masks that pick out one whole byte per channel are supported
+    int red_byte = 2;
+    int green_byte = 1;
+    int blue_byte = 0;
+    if (compression == BI_BITFIELDS)
+    {
+        int masks_end = BMP_HEADER_SIZE + DIB_HEADER_SIZE + BITFIELDS_MASKS_SIZE;
+        if (size < masks_end || (dib_size > DIB_HEADER_SIZE && BMP_HEADER_SIZE + dib_size < masks_end) ||
+            max((long long)masks_end, BMP_HEADER_SIZE + dib_size) > start)
+        {
+            return false;
+        }
+        red_byte = get_mask_byte(get_le(header, 54, 4));
+        green_byte = get_mask_byte(get_le(header, 58, 4));
+        blue_byte = get_mask_byte(get_le(header, 62, 4));
+        if (red_byte < 0 || green_byte < 0 || blue_byte < 0 || red_byte == green_byte || red_byte == blue_byte ||
+            green_byte == blue_byte)
+        {
+            return false;
+        }
+    }
+
+    // Scan lines must occupy multiples of four bytes, and an uncompressed pixel array must fit in the file
+    long long row_stride = (width * bits_per_pixel + 31) / 32 * 4;
+    if (compression != BI_RLE8 && start + row_stride * height > file_size)
+    {
+        return false;
+    }
+
+    info.start = start;
+    info.dib_size = dib_size;
+    info.width = width;
+    info.height = height;
+    info.bits_per_pixel = bits_per_pixel;
+    info.compression = compression;
+    info.palette_colors = palette_colors;
+    info.row_stride = row_stride;
+    info.file_size = file_size;
+    info.red_byte = red_byte;
+    info.green_byte = green_byte;
+    info.blue_byte = blue_byte;
+    return true;
 }
 
-// helper function to prompt user to enter an input filename
-string get_input_filename()
+// helper function to read and check the image properties from the headers of a BMP file
+// @param stream the open BMP file
+// @param info   filled in with the image properties
+// @return true if the file is a BMP image this program can read
+bool read_bmp_info(fstream &stream, BmpInfo &info)
 {
-    string filename;
-    cout << "Please select a BMP file to process. Remember to include the full pathway if not local, and the extension BMP.";
-    cout << endl;
-    cin >> filename;
-    return filename;
+    long long file_size = get_file_size(stream);
+    unsigned char header[BMP_HEADER_SIZE + DIB_HEADER_SIZE + BITFIELDS_MASKS_SIZE];
+    stream.read((char *)header, sizeof(header));
+    long long header_size = stream.gcount();
+
+    // Small images can be shorter than the space read for the masks
+    stream.clear();
+    return parse_bmp_header(header, header_size, file_size, info);
+}
+
+// helper function to fill in the BMP and DIB headers
+// @param header         Array of BMP_HEADER_SIZE + DIB_HEADER_SIZE bytes to fill in
+// @param width          Width of the image in pixels
+// @param height         Height of the image in pixels
+// @param bits_per_pixel Number of bits per pixel (1, 8 or 24)
+// @param compression    Compression method (BI_RGB or BI_RLE8)
+// @param palette_colors Number of colors in the palette that follows the headers (0 for 24 bit images)
+// @param array_bytes    Size of the pixel array in bytes, including padding
+void set_bmp_headers(unsigned char header[], int width, int height, int bits_per_pixel, int compression,
+                     int palette_colors, int array_bytes)
+{
+    unsigned char *dib_header = header + BMP_HEADER_SIZE;
+    int start = BMP_HEADER_SIZE + DIB_HEADER_SIZE + palette_colors * 4;
+
+    // BMP Header
+    set_bytes(header, 0, 1, 'B');                   // ID field
+    set_bytes(header, 1, 1, 'M');                   // ID field
+    set_bytes(header, 2, 4, start + array_bytes);   // Size of BMP file
+    set_bytes(header, 6, 2, 0);                     // Reserved
+    set_bytes(header, 8, 2, 0);                     // Reserved
+    set_bytes(header, 10, 4, start);                // Pixel array offset
+
+    // DIB Header
+    set_bytes(dib_header, 0, 4, DIB_HEADER_SIZE);   // DIB header size
+    set_bytes(dib_header, 4, 4, width);             // Width of bitmap in pixels
+    set_bytes(dib_header, 8, 4, height);            // Height of bitmap in pixels
+    set_bytes(dib_header, 12, 2, 1);                // Number of color planes
+    set_bytes(dib_header, 14, 2, bits_per_pixel);   // Number of bits per pixel
+    set_bytes(dib_header, 16, 4, compression);      // Compression method
+    set_bytes(dib_header, 20, 4, array_bytes);      // Size of raw bitmap data (including padding)
+    set_bytes(dib_header, 24, 4, 2835);             // Print resolution of image (2835 pixels/meter)
+    set_bytes(dib_header, 28, 4, 2835);             // Print resolution of image (2835 pixels/meter)
+    set_bytes(dib_header, 32, 4, palette_colors);   // Number of colors in palette
+    set_bytes(dib_header, 36, 4, 0);                // Number of important colors
 }
 
-// helper function to determine max between 3 ints
-int max_int(int a, int b, int c)
+// helper function for read_image_parallel()
+// Reads the file rows first_row up to (not including) last_row into the image.
+// Each thread opens its own stream so every range is read with its own file position.
+// Note: file row 0 is the bottom row of the image
+void read_bmp_rows(string filename, const BmpInfo &info, int first_row, int last_row,
+                   vector<vector<Pixel>> &image, char &success)
 {
-    if (a >= b && a >= c)
+    int row_stride = info.row_stride;
+    int bytes_per_pixel = info.bits_per_pixel / 8;
+    fstream stream;
+    stream.open(filename, ios::in | ios::binary);
+    if (!stream.is_open())
+    {
+        success = false;
+        return;
+    }
+
+    int height = image.size();
+    int width = image[0].size();
+    vector<unsigned char> buffer((long long)IO_BLOCK_ROWS * row_stride);
+    stream.seekg(info.start + (long long)first_row * row_stride);
+
+    for (int block_row = first_row; block_row < last_row; block_row += IO_BLOCK_ROWS)
     {
-        return a;
+        int block_rows = min(IO_BLOCK_ROWS, last_row - block_row);
+        stream.read((char *)buffer.data(), (long long)block_rows * row_stride);
+        if (stream.gcount() != (long long)block_rows * row_stride)
+        {
+            success = false;
+            return;
+        }
+
+        for (int i = 0; i < block_rows; i++)
+        {
+            // Note: BMP files store pixels in blue, green, red order unless the headers say otherwise
+            const unsigned char *bytes = buffer.data() + (long long)i * row_stride;
+            vector<Pixel> &row = image[height - 1 - (block_row + i)];
+            for (int j = 0; j < width; j++)
+            {
+                row[j].blue = bytes[info.blue_byte];
+                row[j].green = bytes[info.green_byte];
+                row[j].red = bytes[info.red_byte];
+                bytes = bytes + bytes_per_pixel;
+            }
+        }
     }
-    else if (b >= a && b >= c)
+    success = true;
+}
+
+// helper function to read a 24 or 32 bit BMP whose headers have already been checked
+// @param filename    BMP image filename
+// @param info        the image properties from read_bmp_info()
+// @param num_threads number of threads to read with, or 0 to choose from the image size
+// @return the image as a vector of vector of Pixels, or an empty vector if the file is invalid
+vector<vector<Pixel>> read_bmp_rgb(string filename, const BmpInfo &info, int num_threads)
+{
+    int width = info.width;
+    int height = info.height;
+    int row_stride = info.row_stride;
+
+    vector<vector<Pixel>> image(height, vector<Pixel>(width));
+
+    // Give each thread an equal share of the rows. A single range is read on this thread
+    int thread_count = get_io_thread_count(height, row_stride, num_threads);
+    vector<char> success(thread_count, false);
+    if (thread_count == 1)
     {
-        return b;
+        read_bmp_rows(filename, info, 0, height, image, success[0]);
     }
     else
     {
-        return c;
+        vector<thread> threads;
+        for (int t = 0; t < thread_count; t++)
+        {
+            int first_row = (long long)height * t / thread_count;
+            int last_row = (long long)height * (t + 1) / thread_count;
+            threads.push_back(thread(read_bmp_rows, filename, cref(info), first_row, last_row, ref(image),
+                                     ref(success[t])));
+        }
+        for (int t = 0; t < thread_count; t++)
+        {
+            threads[t].join();
+        }
+    }
+
+    for (int t = 0; t < thread_count; t++)
+    {
+        if (!success[t])
+        {
+            return {};
+        }
+    }
+    return image;
+}
+
+// Reads the BMP image specified, splitting the pixel array into row ranges that are read concurrently
+// Every row starts at start + row * (scanline_size + padding), so the ranges are independent
+// @param filename    BMP image filename
+// @param num_threads number of threads to read with (1 by default), or 0 to choose from the image size
+// @return the image as a vector of vector of Pixels, or an empty vector if the file is invalid
+vector<vector<Pixel>> read_image_parallel(string filename, int num_threads = 1)
+{
+    fstream stream;
+    stream.open(filename, ios::in | ios::binary);
+    if (!stream.is_open())
+    {
+        return {};
+    }
+
+    // Get the image properties
+    BmpInfo info;
+    bool is_bmp = read_bmp_info(stream, info);
+    stream.close();
+
+    // Only 24 and 32 bit images store one pixel per 3 or 4 bytes
+    if (!is_bmp || (info.bits_per_pixel != 24 && info.bits_per_pixel != 32))
+    {
+        return {};
     }
+    return read_bmp_rgb(filename, info, num_threads);
 }
-// Process 1
-// Adds vignette effect to image (dark corners)
-vector<vector<Pixel>> process_1(const vector<vector<Pixel>> &image)
+
+// helper function for write_image_parallel()
+// Writes the image rows that belong in file rows first_row up to (not including) last_row.
+// The file must already exist at its full size, so it is opened without truncating it
+void write_bmp_rows(string filename, int start, int row_stride, int first_row, int last_row,
+                    const vector<vector<Pixel>> &image, char &success)
 {
-    double num_rows = image.size();
-    double num_columns = image[0].size();
-    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
+    fstream stream;
+    stream.open(filename, ios::in | ios::out | ios::binary);
+    if (!stream.is_open())
+    {
+        success = false;
+        return;
+    }
 
-    for (int row = 0; row < num_rows; row++)
+    int height = image.size();
+    int width = image[0].size();
+    // The buffer starts zeroed and the padding bytes are never written over
+    vector<unsigned char> buffer((long long)IO_BLOCK_ROWS * row_stride, 0);
+    stream.seekp(start + (long long)first_row * row_stride);
+
+    for (int block_row = first_row; block_row < last_row; block_row += IO_BLOCK_ROWS)
     {
-        for (int column = 0; column < num_columns; column++)
+        int block_rows = min(IO_BLOCK_ROWS, last_row - block_row);
+        for (int i = 0; i < block_rows; i++)
         {
+            // Write the pixel (Blue, Green, Red)
+            unsigned char *bytes = buffer.data() + (long long)i * row_stride;
+            const vector<Pixel> &row = image[height - 1 - (block_row + i)];
+            for (int j = 0; j < width; j++)
+            {
+                bytes[0] = row[j].blue;
+                bytes[1] = row[j].green;
+                bytes[2] = row[j].red;
+                bytes = bytes + 3;
+            }
+        }
+        stream.write((char *)buffer.data(), (long long)block_rows * row_stride);
+    }
 
-            double red = image[row][column].red;
-            double green = image[row][column].green;
-            double blue = image[row][column].blue;
+    success = stream.good();
+    stream.close();
+}
 
-            double distance = sqrt(pow(column - (num_columns / 2.0), 2) + pow(row - (num_rows / 2.0), 2));
-            double scaling_factor = (num_rows - distance) / num_rows;
+// Write the input image to a BMP file, splitting the pixel array into row ranges that are written concurrently
+// @param filename    The BMP file name to save the image to
+// @param image       The input image to save
+// @param num_threads Number of threads to write with (1 by default), or 0 to choose from the image size
+// @return True if successful and false otherwise
+bool write_image_parallel(string filename, const vector<vector<Pixel>> &image, int num_threads = 1)
+{
+    if (image.empty() || image[0].empty())
+    {
+        return false;
+    }
 
-            double new_red = red * scaling_factor;
-            double new_green = green * scaling_factor;
-            double new_blue = blue * scaling_factor;
+    int width = image[0].size();
+    int height = image.size();
+    int row_stride = width * 3 + (4 - width * 3 % 4) % 4;
+    int array_bytes = row_stride * height;
+    int start = BMP_HEADER_SIZE + DIB_HEADER_SIZE;
 
-            new_image[row][column].red = new_red;
-            new_image[row][column].green = new_green;
-            new_image[row][column].blue = new_blue;
+    // Write the headers and size the file up front so every thread can write its own range
+    fstream stream;
+    stream.open(filename, ios::out | ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+    unsigned char header[BMP_HEADER_SIZE + DIB_HEADER_SIZE] = {0};
+    set_bmp_headers(header, width, height, 24, BI_RGB, 0, array_bytes);
+    stream.write((char *)header, sizeof(header));
+    stream.seekp(start + array_bytes - 1);
+    stream.put(0);
+    bool header_written = stream.good();
+    stream.close();
+    if (!header_written)
+    {
+        return false;
+    }
+
+    // A single range is written on this thread
+    int thread_count = get_io_thread_count(height, row_stride, num_threads);
+    vector<char> success(thread_count, false);
+    if (thread_count == 1)
+    {
+        write_bmp_rows(filename, start, row_stride, 0, height, image, success[0]);
+    }
+    else
+    {
+        vector<thread> threads;
+        for (int t = 0; t < thread_count; t++)
+        {
+            int first_row = (long long)height * t / thread_count;
+            int last_row = (long long)height * (t + 1) / thread_count;
+            threads.push_back(thread(write_bmp_rows, filename, start, row_stride, first_row, last_row,
+                                     cref(image), ref(success[t])));
+        }
+        for (int t = 0; t < thread_count; t++)
+        {
+            threads[t].join();
         }
     }
-    return new_image;
+
+    for (int t = 0; t < thread_count; t++)
+    {
+        if (!success[t])
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
-// Process 2
-// Adds Clarendon effect to image (darks darker and lights lighter) by a scaling factor)
-vector<vector<Pixel>> process_2(const vector<vector<Pixel>> &image, double scaling_factor)
+// helper function to find the colors used by an image
+// Colors are compared as the bytes they would be written as
+// @param image      The input image
+// @param max_colors Stop looking once the image uses more than this many colors
+// @param palette    Filled with the colors used, in order of first use
+// @param indices    Filled with the palette index of every pixel
+// @return true if the image uses at most max_colors colors
+bool get_image_palette(const vector<vector<Pixel>> &image, int max_colors, vector<Pixel> &palette,
+                       vector<vector<unsigned char>> &indices)
 {
     int num_rows = image.size();
     int num_columns = image[0].size();
-    double average_value;
-    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
+    unordered_map<int, int> color_index;
+    palette.clear();
+    indices.assign(num_rows, vector<unsigned char>(num_columns));
 
+    // Neighbouring pixels are usually the same color, so remember the last lookup
+    int last_color = -1;
+    int last_index = 0;
     for (int row = 0; row < num_rows; row++)
     {
         for (int column = 0; column < num_columns; column++)
         {
+            unsigned char red = image[row][column].red;
+            unsigned char green = image[row][column].green;
+            unsigned char blue = image[row][column].blue;
+            int color = (red << 16) | (green << 8) | blue;
 
-            double red = image[row][column].red;
-            double green = image[row][column].green;
-            double blue = image[row][column].blue;
-
-            double new_red;
-            double new_green;
-            double new_blue;
+            if (color != last_color)
+            {
+                unordered_map<int, int>::iterator found = color_index.find(color);
+                if (found != color_index.end())
+                {
+                    last_index = found->second;
+                }
+                else
+                {
+                    if ((int)palette.size() == max_colors)
+                    {
+                        return false;
+                    }
+                    last_index = palette.size();
+                    color_index[color] = last_index;
+                    palette.push_back({red, green, blue});
+                }
+                last_color = color;
+            }
+            indices[row][column] = last_index;
+        }
+    }
+    return true;
+}
 
-            average_value = (red + green + blue) / 3.0;
+// helper function to pack palette indices into BMP rows (bottom to top, padded to four bytes)
+// @param indices        Palette index of every pixel
+// @param bits_per_pixel 1 or 8
+// @return the pixel array as it is stored in the file
+vector<unsigned char> pack_bmp_rows(const vector<vector<unsigned char>> &indices, int bits_per_pixel)
+{
+    int height = indices.size();
+    int width = indices[0].size();
+    int row_stride = (((long long)width * bits_per_pixel + 31) / 32) * 4;
+    vector<unsigned char> pixel_array((long long)row_stride * height, 0);
 
-            if (average_value >= 170)
+    for (int h = height - 1; h >= 0; h--)
+    {
+        unsigned char *bytes = pixel_array.data() + (long long)(height - 1 - h) * row_stride;
+        for (int w = 0; w < width; w++)
+        {
+            if (bits_per_pixel == 8)
             {
-                new_red = (255 - (255 - red) * scaling_factor);
-                new_green = (255 - (255 - green) * scaling_factor);
-                new_blue = (255 - (255 - blue) * scaling_factor);
+                bytes[w] = indices[h][w];
             }
-
-            else if (average_value < 90)
+            else
             {
-                new_red = red * scaling_factor;
-                new_green = green * scaling_factor;
-                new_blue = blue * scaling_factor;
+                // The leftmost pixel is the most significant bit
+                bytes[w / 8] |= indices[h][w] << (7 - w % 8);
             }
+        }
+    }
+    return pixel_array;
+}
 
-            else
+// helper function to compress palette indices with BMP run length encoding (RLE8)
+// Runs of one color are stored as (count, index) and everything else in absolute mode
+// @param indices Palette index of every pixel
+// @return the encoded pixel array as it is stored in the file
+vector<unsigned char> encode_bmp_rle8(const vector<vector<unsigned char>> &indices)
+{
+    int height = indices.size();
+    int width = indices[0].size();
+    vector<unsigned char> encoded;
+
+    for (int h = height - 1; h >= 0; h--)
+    {
+        const vector<unsigned char> &row = indices[h];
+        int w = 0;
+        while (w < width)
+        {
+            int run = 1;
+            while (w + run < width && run < 255 && row[w + run] == row[w])
             {
-                new_red = red;
-                new_green = green;
-                new_blue = blue;
+                run++;
+            }
+            if (run >= 2)
+            {
+                encoded.push_back(run);
+                encoded.push_back(row[w]);
+                w = w + run;
+                continue;
             }
 
-            new_image[row][column].red = new_red;
+            // Collect pixels until the next run of at least two starts
+            int literal = 1;
+            while (w + literal < width && literal < 255 &&
+                   !(w + literal + 1 < width && row[w + literal] == row[w + literal + 1]))
+            {
+                literal++;
+            }
+            if (literal < 3)
+            {
+                // Absolute mode needs at least three pixels
+                for (int i = 0; i < literal; i++)
+                {
+                    encoded.push_back(1);
+                    encoded.push_back(row[w + i]);
+                }
+            }
+            else
+            {
+                encoded.push_back(0);
+                encoded.push_back(literal);
+                encoded.insert(encoded.end(), row.begin() + w, row.begin() + w + literal);
+                // Absolute runs are padded to a multiple of two bytes
+                if (literal % 2 != 0)
+                {
+                    encoded.push_back(0);
+                }
+            }
+            w = w + literal;
+        }
+
+        // End of line
+        encoded.push_back(0);
+        encoded.push_back(0);
+    }
+
+    // End of bitmap
+    encoded.push_back(0);
+    encoded.push_back(1);
+    return encoded;
+}
+
+// helper function to expand a BMP RLE8 pixel array into palette indices
+// Pixels skipped over by the encoding keep index 0
+// @param encoded The encoded pixel array
+// @param indices Palette index of every pixel, already sized to the image
+// @return true if the encoding was valid
+bool decode_bmp_rle8(const vector<unsigned char> &encoded, vector<vector<unsigned char>> &indices)
+{
+    int height = indices.size();
+    int width = indices[0].size();
+    long long x = 0;
+    long long y = 0; // Counted from the bottom row
+    size_t pos = 0;
+
+    while (pos + 1 < encoded.size())
+    {
+        int count = encoded[pos];
+        int value = encoded[pos + 1];
+        pos = pos + 2;
+
+        if (count > 0)
+        {
+            // Run of one color
+            for (int i = 0; i < count; i++, x++)
+            {
+                if (x < width && y < height)
+                {
+                    indices[height - 1 - y][x] = value;
+                }
+            }
+        }
+        else if (value == 0)
+        {
+            // End of line
+            x = 0;
+            y++;
+        }
+        else if (value == 1)
+        {
+            // End of bitmap
+            return true;
+        }
+        else if (value == 2)
+        {
+            // Delta: move right and up
+            if (pos + 1 >= encoded.size())
+            {
+                return false;
+            }
+            x = x + encoded[pos];
+            y = y + encoded[pos + 1];
+            pos = pos + 2;
+        }
+        else
+        {
+            // Absolute mode: value pixels follow, padded to two bytes
+            if (pos + value > encoded.size())
+            {
+                return false;
+            }
+            for (int i = 0; i < value; i++, x++)
+            {
+                if (x < width && y < height)
+                {
+                    indices[height - 1 - y][x] = encoded[pos + i];
+                }
+            }
+            pos = pos + value + value % 2;
+        }
+    }
+    return true;
+}
+
+// Reads a BMP image that uses a color palette (1, 4 or 8 bits per pixel, uncompressed or RLE8)
+// @param stream the open BMP file
+// @param info   the image properties from read_bmp_info()
+// @return the image as a vector of vector of Pixels, or an empty vector if the file is invalid
+vector<vector<Pixel>> read_bmp_paletted(fstream &stream, const BmpInfo &info)
+{
+    int bits_per_pixel = info.bits_per_pixel;
+    int palette_colors = info.palette_colors;
+    int width = info.width;
+    int height = info.height;
+    long long row_stride = info.row_stride;
+    bool rle8 = info.compression == BI_RLE8;
+
+    // An uncompressed pixel array is row_stride * height bytes. RLE8 never needs more than
+    // two bytes per pixel plus an end of line code per row, so anything past that is ignored
+    long long array_bytes = row_stride * height;
+    if (rle8)
+    {
+        array_bytes = min(info.file_size - info.start, 2LL * width * height + 2LL * height + 2);
+    }
+
+    // Palette entries are stored as blue, green, red, reserved
+    vector<unsigned char> palette_bytes(palette_colors * 4);
+    stream.seekg(BMP_HEADER_SIZE + info.dib_size);
+    stream.read((char *)palette_bytes.data(), palette_bytes.size());
+    vector<unsigned char> pixel_array(array_bytes);
+    stream.seekg(info.start);
+    stream.read((char *)pixel_array.data(), pixel_array.size());
+    if (!stream)
+    {
+        return {};
+    }
+    stream.close();
+
+    vector<vector<unsigned char>> indices(height, vector<unsigned char>(width, 0));
+    if (rle8)
+    {
+        if (!decode_bmp_rle8(pixel_array, indices))
+        {
+            return {};
+        }
+    }
+    else
+    {
+        int pixels_per_byte = 8 / bits_per_pixel;
+        int mask = (1 << bits_per_pixel) - 1;
+        for (int h = 0; h < height; h++)
+        {
+            // Note: BMP files store pixels from bottom to top
+            const unsigned char *bytes = pixel_array.data() + (height - 1 - h) * row_stride;
+            for (int w = 0; w < width; w++)
+            {
+                int shift = (pixels_per_byte - 1 - w % pixels_per_byte) * bits_per_pixel;
+                indices[h][w] = (bytes[w / pixels_per_byte] >> shift) & mask;
+            }
+        }
+    }
+
+    vector<vector<Pixel>> image(height, vector<Pixel>(width));
+    for (int h = 0; h < height; h++)
+    {
+        for (int w = 0; w < width; w++)
+        {
+            int index = indices[h][w];
+            if (index >= palette_colors)
+            {
+                return {};
+            }
+            image[h][w].blue = palette_bytes[index * 4];
+            image[h][w].green = palette_bytes[index * 4 + 1];
+            image[h][w].red = palette_bytes[index * 4 + 2];
+        }
+    }
+    return image;
+}
+
+// helper function to write a BMP file that uses a color palette
+// @param filename       The BMP file name to save the image to
+// @param width          Width of the image in pixels
+// @param height         Height of the image in pixels
+// @param bits_per_pixel 1 or 8
+// @param compression    BI_RGB or BI_RLE8
+// @param palette        The colors the pixel array refers to
+// @param pixel_array    The pixel array as it is stored in the file
+// @return True if successful and false otherwise
+bool write_bmp_paletted(string filename, int width, int height, int bits_per_pixel, int compression,
+                        const vector<Pixel> &palette, const vector<unsigned char> &pixel_array)
+{
+    fstream stream;
+    stream.open(filename, ios::out | ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+
+    unsigned char header[BMP_HEADER_SIZE + DIB_HEADER_SIZE] = {0};
+    set_bmp_headers(header, width, height, bits_per_pixel, compression, palette.size(), pixel_array.size());
+    stream.write((char *)header, sizeof(header));
+
+    // Palette entries are stored as blue, green, red, reserved
+    vector<unsigned char> palette_bytes(palette.size() * 4, 0);
+    for (size_t i = 0; i < palette.size(); i++)
+    {
+        palette_bytes[i * 4] = palette[i].blue;
+        palette_bytes[i * 4 + 1] = palette[i].green;
+        palette_bytes[i * 4 + 2] = palette[i].red;
+    }
+    stream.write((char *)palette_bytes.data(), palette_bytes.size());
+    stream.write((char *)pixel_array.data(), pixel_array.size());
+
+    bool success = stream.good();
+    stream.close();
+    return success;
+}
+
+// Reads a BMP image in any of the supported layouts
+// @param stream   the open BMP file
+// @param filename    BMP image filename, reopened by each row-range thread for 24 and 32 bit images
+// @param num_threads number of threads to read 24 and 32 bit images with, or 0 to choose from the image size
+// @return the image as a vector of vector of Pixels, or an empty vector if the file is invalid
+vector<vector<Pixel>> read_bmp(fstream &stream, string filename, int num_threads)
+{
+    BmpInfo info;
+    if (!read_bmp_info(stream, info))
+    {
+        return {};
+    }
+    if (info.bits_per_pixel <= 8)
+    {
+        return read_bmp_paletted(stream, info);
+    }
+    stream.close();
+    return read_bmp_rgb(filename, info, num_threads);
+}
+
+// Writes the image to a BMP file using the smallest layout that holds it exactly:
+// 1 bit for two color images (such as process 7), 8 bit or RLE8 for up to 256 colors
+// (such as process 3 and process 10) and 24 bit otherwise
+// @param filename    The BMP file name to save the image to
+// @param image       The input image to save
+// @param num_threads Number of threads to write 24 bit images with, or 0 to choose from the image size
+// @return True if successful and false otherwise
+bool write_bmp(string filename, const vector<vector<Pixel>> &image, int num_threads)
+{
+    vector<Pixel> palette;
+    vector<vector<unsigned char>> indices;
+    if (!get_image_palette(image, 256, palette, indices))
+    {
+        return write_image_parallel(filename, image, num_threads);
+    }
+
+    int width = image[0].size();
+    int height = image.size();
+    int bits_per_pixel = 8;
+    if (palette.size() <= 2)
+    {
+        bits_per_pixel = 1;
+    }
+    vector<unsigned char> pixel_array = pack_bmp_rows(indices, bits_per_pixel);
+    vector<unsigned char> encoded = encode_bmp_rle8(indices);
+    if (encoded.size() < pixel_array.size())
+    {
+        return write_bmp_paletted(filename, width, height, 8, BI_RLE8, palette, encoded);
+    }
+    return write_bmp_paletted(filename, width, height, bits_per_pixel, BI_RGB, palette, pixel_array);
+}
+
+// helper function to read the next number from a PPM/PGM/PBM header, skipping whitespace and # comments
+// @return the number, or -1 if there is none
+int read_pnm_number(fstream &stream)
+{
+    int c = stream.get();
+    while (c == '#' || isspace(c))
+    {
+        if (c == '#')
+        {
+            while (c != '\n' && c != EOF)
+            {
+                c = stream.get();
+            }
+        }
+        c = stream.get();
+    }
+    if (!isdigit(c))
+    {
+        return -1;
+    }
+
+    int number = 0;
+    while (isdigit(c))
+    {
+        number = number * 10 + (c - '0');
+        if (number > 1000000)
+        {
+            return -1;
+        }
+        c = stream.get();
+    }
+    // The single whitespace character after the number has been used up
+    return isspace(c) ? number : -1;
+}
+
+// Reads a binary PPM (P6), PGM (P5) or PBM (P4) image
+// @param stream the open image file
+// @return the image as a vector of vector of Pixels, or an empty vector if the file is invalid
+vector<vector<Pixel>> read_pnm(fstream &stream, string, int)
+{
+    if (stream.get() != 'P')
+    {
+        return {};
+    }
+    int type = stream.get();
+    if (type != '4' && type != '5' && type != '6')
+    {
+        return {};
+    }
+
+    int width = read_pnm_number(stream);
+    int height = read_pnm_number(stream);
+    int max_value = 1;
+    if (type != '4')
+    {
+        max_value = read_pnm_number(stream);
+    }
+    if (!check_image_size(width, height) || max_value <= 0 || max_value > 255)
+    {
+        return {};
+    }
+
+    // PBM packs eight pixels per byte, PGM uses one byte and PPM three bytes per pixel
+    long long row_bytes = (width + 7) / 8;
+    if (type == '5')
+    {
+        row_bytes = width;
+    }
+    else if (type == '6')
+    {
+        row_bytes = (long long)width * 3;
+    }
+
+    // Check the pixel data is all there before allocating room for it
+    long long data_start = stream.tellg();
+    stream.seekg(0, ios::end);
+    long long file_size = stream.tellg();
+    if (data_start < 0 || file_size - data_start < row_bytes * height)
+    {
+        return {};
+    }
+    stream.seekg(data_start);
+
+    vector<unsigned char> data(row_bytes * height);
+    stream.read((char *)data.data(), data.size());
+    if (stream.gcount() != (long long)data.size())
+    {
+        return {};
+    }
+    stream.close();
+
+    vector<vector<Pixel>> image(height, vector<Pixel>(width));
+    for (int row = 0; row < height; row++)
+    {
+        const unsigned char *bytes = data.data() + row * row_bytes;
+        for (int column = 0; column < width; column++)
+        {
+            if (type == '4')
+            {
+                // A set bit is black
+                int value = ((bytes[column / 8] >> (7 - column % 8)) & 1) ? 0 : 255;
+                image[row][column] = {value, value, value};
+            }
+            else if (type == '5')
+            {
+                int value = bytes[column] * 255 / max_value;
+                image[row][column] = {value, value, value};
+            }
+            else
+            {
+                image[row][column].red = bytes[column * 3] * 255 / max_value;
+                image[row][column].green = bytes[column * 3 + 1] * 255 / max_value;
+                image[row][column].blue = bytes[column * 3 + 2] * 255 / max_value;
+            }
+        }
+    }
+    return image;
+}
+
+// Luminance weights for red, green and blue in fixed point (scaled by 65536, each set sums to 65536)
+struct LumaWeights
+{
+    int red;
+    int green;
+    int blue;
+};
+const LumaWeights REC_601 = {19595, 38470, 7471}; // 0.299, 0.587, 0.114 (standard definition video, JPEG)
+const LumaWeights REC_709 = {13933, 46871, 4732}; // 0.2126, 0.7152, 0.0722 (HD video, sRGB)
+
+#ifdef __SSE2__
+// helper function to multiply four pairs of 32 bit integers, keeping the low 32 bits of each product
+// (SSE2 has no single instruction for this, so the even and odd lanes are multiplied separately)
+__m128i multiply_lanes(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Picks four 32 bit lanes out of two registers: lanes a0 and a1 of a, then lanes b0 and b1 of b
+// (a macro because the lane numbers must be compile-time constants)
+#define PICK_LANES(a, b, a0, a1, b0, b1) \
+    _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(b1, b0, a1, a0)))
+#endif
+
+// helper function to get the luminance of every pixel in a row
+// With SSE2, four pixels are done at a time: their 12 values are loaded as three registers,
+// regrouped into one register each of red, green and blue, and weighted together.
+// The rest of the row (or the whole row without SSE2) uses the same formula one pixel at a time
+// @param row     the pixels
+// @param weights the luminance weights to use
+// @param luma    filled with the luminance (0 to 255) of each pixel
+void get_row_luminance(const vector<Pixel> &row, const LumaWeights &weights, vector<int> &luma)
+{
+    int width = row.size();
+    const Pixel *pixels = row.data();
+    int *out = luma.data();
+    int i = 0;
+#ifdef __SSE2__
+    static_assert(sizeof(Pixel) == 3 * sizeof(int), "Pixel must be three packed ints");
+    __m128i red_weight = _mm_set1_epi32(weights.red);
+    __m128i green_weight = _mm_set1_epi32(weights.green);
+    __m128i blue_weight = _mm_set1_epi32(weights.blue);
+    __m128i rounding = _mm_set1_epi32(32768);
+    for (; i + 4 <= width; i += 4)
+    {
+        // r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3
+        const __m128i *values = (const __m128i *)(pixels + i);
+        __m128i v0 = _mm_loadu_si128(values);
+        __m128i v1 = _mm_loadu_si128(values + 1);
+        __m128i v2 = _mm_loadu_si128(values + 2);
+
+        __m128i red = PICK_LANES(v0, PICK_LANES(v1, v2, 2, 2, 1, 1), 0, 3, 0, 2);
+        __m128i green = PICK_LANES(PICK_LANES(v0, v1, 1, 1, 0, 0), PICK_LANES(v1, v2, 3, 3, 2, 2), 0, 2, 0, 2);
+        __m128i blue = PICK_LANES(PICK_LANES(v0, v1, 2, 2, 1, 1), v2, 0, 2, 0, 3);
+
+        __m128i sum = _mm_add_epi32(multiply_lanes(red, red_weight), multiply_lanes(green, green_weight));
+        sum = _mm_add_epi32(sum, multiply_lanes(blue, blue_weight));
+        sum = _mm_srai_epi32(_mm_add_epi32(sum, rounding), 16);
+        _mm_storeu_si128((__m128i *)(out + i), sum);
+    }
+#endif
+    for (; i < width; i++)
+    {
+        out[i] = (pixels[i].red * weights.red + pixels[i].green * weights.green + pixels[i].blue * weights.blue +
+                  32768) >> 16;
+    }
+}
+
+// helper function to write a binary PPM/PGM/PBM file
+// @param filename The file name to save the image to
+// @param type     '4' for PBM, '5' for PGM or '6' for PPM
+// @param image    The input image to save
+// @return True if successful and false otherwise
+bool write_pnm(string filename, char type, const vector<vector<Pixel>> &image)
+{
+    int width = image[0].size();
+    int height = image.size();
+
+    fstream stream;
+    stream.open(filename, ios::out | ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+    stream << 'P' << type << '\n' << width << ' ' << height << '\n';
+    if (type != '4')
+    {
+        stream << 255 << '\n';
+    }
+
+    long long row_bytes = (width + 7) / 8;
+    if (type == '5')
+    {
+        row_bytes = width;
+    }
+    else if (type == '6')
+    {
+        row_bytes = (long long)width * 3;
+    }
+    vector<unsigned char> row_data(row_bytes);
+    vector<int> luma(width);
+    for (int row = 0; row < height; row++)
+    {
+        fill(row_data.begin(), row_data.end(), 0);
+        if (type != '6')
+        {
+            // Same gray as the grayscale filter (process 3)
+            get_row_luminance(image[row], REC_601, luma);
+        }
+        for (int column = 0; column < width; column++)
+        {
+            unsigned char red = image[row][column].red;
+            unsigned char green = image[row][column].green;
+            unsigned char blue = image[row][column].blue;
+            int gray_value = luma[column];
+
+            if (type == '4')
+            {
+                // A set bit is black
+                if (gray_value < 128)
+                {
+                    row_data[column / 8] |= 1 << (7 - column % 8);
+                }
+            }
+            else if (type == '5')
+            {
+                row_data[column] = gray_value;
+            }
+            else
+            {
+                row_data[column * 3] = red;
+                row_data[column * 3 + 1] = green;
+                row_data[column * 3 + 2] = blue;
+            }
+        }
+        stream.write((char *)row_data.data(), row_data.size());
+    }
+
+    bool success = stream.good();
+    stream.close();
+    return success;
+}
+
+// Writes the image to a binary PPM file (raw 8 bit red, green, blue)
+bool write_ppm(string filename, const vector<vector<Pixel>> &image, int)
+{
+    return write_pnm(filename, '6', image);
+}
+
+// Writes the image to a binary PGM file (8 bit gray, the same Rec. 601 luminance as process 3)
+bool write_pgm(string filename, const vector<vector<Pixel>> &image, int)
+{
+    return write_pnm(filename, '5', image);
+}
+
+// Writes the image to a binary PBM file (1 bit, gray values below 128 are black)
+bool write_pbm(string filename, const vector<vector<Pixel>> &image, int)
+{
+    return write_pnm(filename, '4', image);
+}
+
+// QOI ("Quite OK Image") operation tags
+const unsigned char QOI_OP_INDEX = 0x00;
+const unsigned char QOI_OP_DIFF = 0x40;
+const unsigned char QOI_OP_LUMA = 0x80;
+const unsigned char QOI_OP_RUN = 0xc0;
+const unsigned char QOI_OP_RGB = 0xfe;
+const unsigned char QOI_OP_RGBA = 0xff;
+const int QOI_HEADER_SIZE = 14;
+const int QOI_END_MARKER_SIZE = 8;
+
+// QOI pixel, which also carries an alpha channel
+struct QoiPixel
+{
+    unsigned char red;
+    unsigned char green;
+    unsigned char blue;
+    unsigned char alpha;
+};
+
+// helper function to find a pixel's slot in the QOI table of recently seen pixels
+int qoi_hash(const QoiPixel &pixel)
+{
+    return (pixel.red * 3 + pixel.green * 5 + pixel.blue * 7 + pixel.alpha * 11) % 64;
+}
+
+// helper function to compare two QOI pixels
+bool qoi_equal(const QoiPixel &a, const QoiPixel &b)
+{
+    return a.red == b.red && a.green == b.green && a.blue == b.blue && a.alpha == b.alpha;
+}
+
+// Reads a QOI image (lossless; the alpha channel is ignored)
+// @param stream the open QOI file
+// @return the image as a vector of vector of Pixels, or an empty vector if the file is invalid
+vector<vector<Pixel>> read_qoi(fstream &stream, string, int)
+{
+    long long file_size = get_file_size(stream);
+    unsigned char header[QOI_HEADER_SIZE];
+    stream.read((char *)header, sizeof(header));
+    if (stream.gcount() != QOI_HEADER_SIZE || memcmp(header, "qoif", 4) != 0)
+    {
+        return {};
+    }
+
+    // Width and height are stored big endian
+    long long width = ((long long)header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
+    long long height = ((long long)header[8] << 24) | (header[9] << 16) | (header[10] << 8) | header[11];
+    int channels = header[12];
+    if (!check_image_size(width, height) || (channels != 3 && channels != 4))
+    {
+        return {};
+    }
+
+    // No pixel takes more than 1 + channels bytes, so a longer file is not a valid QOI image
+    long long max_file_size = QOI_HEADER_SIZE + width * height * (1 + channels) + QOI_END_MARKER_SIZE;
+    if (file_size < QOI_HEADER_SIZE + QOI_END_MARKER_SIZE || file_size > max_file_size)
+    {
+        return {};
+    }
+    vector<unsigned char> data(file_size);
+    stream.seekg(0);
+    stream.read((char *)data.data(), data.size());
+    if (!stream)
+    {
+        return {};
+    }
+    stream.close();
+
+    vector<vector<Pixel>> image(height, vector<Pixel>(width));
+    QoiPixel seen[64] = {};
+    QoiPixel pixel = {0, 0, 0, 255};
+    size_t pos = QOI_HEADER_SIZE;
+    size_t data_end = data.size() - QOI_END_MARKER_SIZE;
+    int run = 0;
+
+    for (int row = 0; row < height; row++)
+    {
+        for (int column = 0; column < width; column++)
+        {
+            if (run > 0)
+            {
+                run--;
+            }
+            else
+            {
+                if (pos >= data_end)
+                {
+                    return {};
+                }
+                unsigned char tag = data[pos++];
+                if (tag == QOI_OP_RGB || tag == QOI_OP_RGBA)
+                {
+                    int channel_bytes = (tag == QOI_OP_RGB) ? 3 : 4;
+                    if (pos + channel_bytes > data_end)
+                    {
+                        return {};
+                    }
+                    pixel.red = data[pos];
+                    pixel.green = data[pos + 1];
+                    pixel.blue = data[pos + 2];
+                    if (tag == QOI_OP_RGBA)
+                    {
+                        pixel.alpha = data[pos + 3];
+                    }
+                    pos = pos + channel_bytes;
+                }
+                else if ((tag & 0xc0) == QOI_OP_INDEX)
+                {
+                    pixel = seen[tag];
+                }
+                else if ((tag & 0xc0) == QOI_OP_DIFF)
+                {
+                    pixel.red += ((tag >> 4) & 0x03) - 2;
+                    pixel.green += ((tag >> 2) & 0x03) - 2;
+                    pixel.blue += (tag & 0x03) - 2;
+                }
+                else if ((tag & 0xc0) == QOI_OP_LUMA)
+                {
+                    if (pos >= data_end)
+                    {
+                        return {};
+                    }
+                    unsigned char second = data[pos++];
+                    int green_diff = (tag & 0x3f) - 32;
+                    pixel.red += green_diff - 8 + ((second >> 4) & 0x0f);
+                    pixel.green += green_diff;
+                    pixel.blue += green_diff - 8 + (second & 0x0f);
+                }
+                else
+                {
+                    run = tag & 0x3f;
+                }
+                seen[qoi_hash(pixel)] = pixel;
+            }
+
+            image[row][column].red = pixel.red;
+            image[row][column].green = pixel.green;
+            image[row][column].blue = pixel.blue;
+        }
+    }
+    return image;
+}
+
+// Writes the image to a QOI file, a simple lossless format that stores each pixel as
+// a repeat of the previous pixel, a recently seen pixel or a small difference where it can
+// @param filename The QOI file name to save the image to
+// @param image    The input image to save
+// @return True if successful and false otherwise
+bool write_qoi(string filename, const vector<vector<Pixel>> &image, int)
+{
+    int width = image[0].size();
+    int height = image.size();
+    vector<unsigned char> data;
+    data.reserve(QOI_HEADER_SIZE + (long long)width * height + QOI_END_MARKER_SIZE);
+
+    // Header: magic, big endian width and height, 3 channels, sRGB color space
+    const char magic[] = "qoif";
+    data.insert(data.end(), magic, magic + 4);
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        data.push_back(width >> shift);
+    }
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        data.push_back(height >> shift);
+    }
+    data.push_back(3);
+    data.push_back(0);
+
+    QoiPixel seen[64] = {};
+    QoiPixel previous = {0, 0, 0, 255};
+    int run = 0;
+    for (int row = 0; row < height; row++)
+    {
+        for (int column = 0; column < width; column++)
+        {
+            QoiPixel pixel;
+            pixel.red = image[row][column].red;
+            pixel.green = image[row][column].green;
+            pixel.blue = image[row][column].blue;
+            pixel.alpha = 255;
+
+            if (qoi_equal(pixel, previous))
+            {
+                run++;
+                if (run == 62)
+                {
+                    data.push_back(QOI_OP_RUN | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0)
+            {
+                data.push_back(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+
+            int hash = qoi_hash(pixel);
+            if (qoi_equal(seen[hash], pixel))
+            {
+                data.push_back(QOI_OP_INDEX | hash);
+            }
+            else
+            {
+                seen[hash] = pixel;
+                // Differences wrap around, so they are taken modulo 256
+                int red_diff = (signed char)(pixel.red - previous.red);
+                int green_diff = (signed char)(pixel.green - previous.green);
+                int blue_diff = (signed char)(pixel.blue - previous.blue);
+                int red_green = red_diff - green_diff;
+                int blue_green = blue_diff - green_diff;
+
+                if (red_diff >= -2 && red_diff <= 1 && green_diff >= -2 && green_diff <= 1 &&
+                    blue_diff >= -2 && blue_diff <= 1)
+                {
+                    data.push_back(QOI_OP_DIFF | (red_diff + 2) << 4 | (green_diff + 2) << 2 | (blue_diff + 2));
+                }
+                else if (green_diff >= -32 && green_diff <= 31 && red_green >= -8 && red_green <= 7 &&
+                         blue_green >= -8 && blue_green <= 7)
+                {
+                    data.push_back(QOI_OP_LUMA | (green_diff + 32));
+                    data.push_back((red_green + 8) << 4 | (blue_green + 8));
+                }
+                else
+                {
+                    data.push_back(QOI_OP_RGB);
+                    data.push_back(pixel.red);
+                    data.push_back(pixel.green);
+                    data.push_back(pixel.blue);
+                }
+            }
+            previous = pixel;
+        }
+    }
+    if (run > 0)
+    {
+        data.push_back(QOI_OP_RUN | (run - 1));
+    }
+
+    // End marker: seven 0x00 bytes and one 0x01 byte
+    data.insert(data.end(), 7, 0);
+    data.push_back(1);
+
+    fstream stream;
+    stream.open(filename, ios::out | ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+    stream.write((char *)data.data(), data.size());
+    bool success = stream.good();
+    stream.close();
+    return success;
+}
+
+// Image file format: how to recognize, read and write it
+// New formats only need a read and a write function and an entry in get_codecs()
+struct Codec
+{
+    string name;      // Format name shown to the user
+    string extension; // Output file extension that selects this format (lowercase)
+    string magic;     // Bytes every file of this format starts with
+    // Reads the open file (positioned at its start); the filename is there for readers that reopen it.
+    // num_threads is the number of I/O threads for formats that split the pixel array (BMP)
+    vector<vector<Pixel>> (*read)(fstream &stream, string filename, int num_threads);
+    bool (*write)(string filename, const vector<vector<Pixel>> &image, int num_threads);
+};
+
+// helper function to list the supported image formats
+// The first entry is used when an output filename has no known extension
+const vector<Codec> &get_codecs()
+{
+    static const vector<Codec> codecs = {
+        {"BMP", ".bmp", "BM", read_bmp, write_bmp},
+        {"PPM", ".ppm", "P6", read_pnm, write_ppm},
+        {"PGM", ".pgm", "P5", read_pnm, write_pgm},
+        {"PBM", ".pbm", "P4", read_pnm, write_pbm},
+        {"QOI", ".qoi", "qoif", read_qoi, write_qoi},
+    };
+    return codecs;
+}
+
+// Reads an image in any supported format, recognizing the format from the start of the file
+// @param filename    image filename
+// @param num_threads number of I/O threads to read with (1 by default), or 0 to choose from the image size
+// @return the image as a vector of vector of Pixels, or an empty vector if the file is invalid
+vector<vector<Pixel>> read_image_file(string filename, int num_threads = 1)
+{
+    fstream stream;
+    stream.open(filename, ios::in | ios::binary);
+    if (!stream.is_open())
+    {
+        return {};
+    }
+    char start[4] = {0};
+    stream.read(start, sizeof(start));
+    string file_start(start, stream.gcount());
+    stream.clear();
+    stream.seekg(0);
+
+    const vector<Codec> &codecs = get_codecs();
+    for (size_t i = 0; i < codecs.size(); i++)
+    {
+        if (file_start.compare(0, codecs[i].magic.size(), codecs[i].magic) == 0)
+        {
+            return codecs[i].read(stream, filename, num_threads);
+        }
+    }
+    return {};
+}
+
+// helper function to find the format chosen by a file name's extension
+// @param filename the file name to save an image to
+// @return the codec for the extension, BMP if the name has no extension, or nullptr if the
+//         extension is not one of the supported formats
+const Codec *get_output_codec(string filename)
+{
+    const vector<Codec> &codecs = get_codecs();
+    size_t dot = filename.rfind('.');
+    size_t slash = filename.find_last_of("/\\");
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+    {
+        return &codecs[0];
+    }
+
+    string extension = filename.substr(dot);
+    for (size_t i = 0; i < extension.size(); i++)
+    {
+        extension[i] = tolower(extension[i]);
+    }
+    for (size_t i = 0; i < codecs.size(); i++)
+    {
+        if (codecs[i].extension == extension)
+        {
+            return &codecs[i];
+        }
+    }
+    return nullptr;
+}
+
+// Writes the image in the format chosen by the filename's extension (BMP if it has none)
+// @param filename    The file name to save the image to
+// @param image       The input image to save
+// @param num_threads Number of I/O threads to write with (1 by default), or 0 to choose from the image size
+// @return True if successful and false otherwise (including for an unsupported extension)
+bool write_image_file(string filename, const vector<vector<Pixel>> &image, int num_threads = 1)
+{
+    const Codec *codec = get_output_codec(filename);
+    if (image.empty() || image[0].empty() || codec == nullptr)
+    {
+        return false;
+    }
+    return codec->write(filename, image, num_threads);
+}
+
+// helper function to prompt user to enter an output filename
+string get_output_filename()
+{
+    string filename;
+    cout << "Please select an output filename for your altered image. Please do not use the input filename as it will be overwritten.";
+    cout << endl;
+    cout << "The extension chooses the format: .bmp (default), .ppm, .pgm (grayscale), .pbm (black and white) or .qoi (compressed).";
+    cout << endl;
+    cin >> filename;
+    while (cin && get_output_codec(filename) == nullptr)
+    {
+        cout << filename;
+        cout << " does not end in one of the extensions above. Please enter another filename.";
+        cout << endl;
+        cin >> filename;
+    }
+    return filename;
+}
+// helper function to print menu of filter options and prompt user for a selection
+// @return the user selection used to determine image processor
+int get_selection()
+{
+    string selection;
+    int selection_to_int;
+    cout << "Please select a filter/option from the list below.\n";
+    cout << "0: Change file selection\n1: Adds Vignette \n2: Adds Clarendon \n3: Grayscale \n4: Rotates 90 Degrees \n5: Rotates (Multiples of 90 Degrees)\n6: Enlarges image in x and y direction (integer values only)\n7: Converts image to high contrast (black and white only)\n8: Lightens image by a scaling factor (integer values only)\n9: Darkens image by a scaling factor (integer values only)\n10: Converts image to only black, white, red, blue, and green\n11: Converts image to a palette of your own colors (with optional dithering)\n12: Grayscale using HD video (Rec. 709) weights\n";
+    cout << "(Enter Q to quit.)\n";
+    cin >> selection;
+    if (selection == "Q" || selection == "q")
+    {
+        cout << "Thank you for using the CSPB1330 image manipulator. Have a great day!\n";
+        selection_to_int = -1;
+        return selection_to_int;
+    }
+    try
+    {
+        selection_to_int = stoi(selection);
+    }
+    // invalid_argument for text, out_of_range for numbers too large for an int
+    catch (const logic_error &user_input)
+    {
+        cout << selection;
+        cout << " is not a valid selection. Please try again\n";
+        selection_to_int = -2;
+    }
+    return selection_to_int;
+}
+
+// helper function to prompt user to enter an input filename
+string get_input_filename()
+{
+    string filename;
+    cout << "Please select a BMP, PPM, PGM, PBM or QOI file to process. Remember to include the full pathway if not local, and the extension.";
+    cout << endl;
+    cout << "(Enter BATCH to process several files with the same filter.)";
+    cout << endl;
+    cin >> filename;
+    return filename;
+}
+
+// Converts an image to grayscale using perceptual luminance weights
+// @param image   the input image
+// @param weights REC_601 or REC_709
+// @return the grayscale image
+vector<vector<Pixel>> to_grayscale(const vector<vector<Pixel>> &image, const LumaWeights &weights)
+{
+    int num_rows = image.size();
+    int num_columns = image[0].size();
+    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
+    vector<int> luma(num_columns);
+    for (int row = 0; row < num_rows; row++)
+    {
+        get_row_luminance(image[row], weights, luma);
+        for (int column = 0; column < num_columns; column++)
+        {
+            new_image[row][column].red = luma[column];
+            new_image[row][column].green = luma[column];
+            new_image[row][column].blue = luma[column];
+        }
+    }
+    return new_image;
+}
+
+// The color cube splits each channel into 2^CUBE_BITS levels (32 x 32 x 32 cells)
+const int CUBE_BITS = 5;
+const int CUBE_SIZE = 1 << CUBE_BITS;
+
+// Most colors a palette can hold
+const int MAX_PALETTE_COLORS = 256;
+
+// Cell of the color cube whose colors do not all map to the same palette color
+const short MIXED_CELL = -1;
+
+// Palette together with a precomputed lookup of the palette color for every cell of the color
+// cube, so mapping most pixels to the palette takes one table lookup. Pixels in a mixed cell
+// are mapped with the rule the cube was built from
+struct ColorCube
+{
+    vector<Pixel> palette;
+    vector<short> nearest; // Palette index for each cell (or MIXED_CELL), indexed by red, green, blue cell
+    int (*classify)(const vector<Pixel> &palette, int red, int green, int blue);
+};
+
+// Ways to spread the error of mapping pixels to a small palette
+enum Dither
+{
+    DITHER_NONE = 0,
+    DITHER_ORDERED = 1,        // 4x4 Bayer threshold pattern
+    DITHER_FLOYD_STEINBERG = 2 // Error diffusion to the neighbouring pixels
+};
+
+// helper function to keep a color value between 0 and 255
+int clamp_color(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+// helper function to find the palette color closest to a color (straight-line distance in RGB)
+// @return the palette index
+int nearest_palette_index(const vector<Pixel> &palette, int red, int green, int blue)
+{
+    int best_index = 0;
+    int best_distance = -1;
+    int palette_size = palette.size();
+    for (int i = 0; i < palette_size; i++)
+    {
+        int red_diff = red - palette[i].red;
+        int green_diff = green - palette[i].green;
+        int blue_diff = blue - palette[i].blue;
+        int distance = red_diff * red_diff + green_diff * green_diff + blue_diff * blue_diff;
+        if (best_distance < 0 || distance < best_distance)
+        {
+            best_distance = distance;
+            best_index = i;
+        }
+    }
+    return best_index;
+}
+
+// Builds the color cube for a palette by checking which palette color each cell's corners map to.
+// The colors that map to one palette color form a convex region for every rule used here (nearest
+// color, or thresholds on sums and comparisons of the channels), so if all eight corners agree the
+// whole cell does. Otherwise the cell is marked MIXED_CELL and its pixels use the rule directly
+// @param palette  between 1 and MAX_PALETTE_COLORS colors
+// @param classify picks the palette index for a color (nearest_palette_index unless a filter
+//                 has its own rule)
+// @return the color cube
+ColorCube build_color_cube(const vector<Pixel> &palette,
+                           int (*classify)(const vector<Pixel> &palette, int red, int green, int blue))
+{
+    ColorCube cube;
+    cube.palette = palette;
+    cube.classify = classify;
+    cube.nearest.resize(CUBE_SIZE * CUBE_SIZE * CUBE_SIZE);
+
+    int cell_width = 256 / CUBE_SIZE;
+    for (int r = 0; r < CUBE_SIZE; r++)
+    {
+        for (int g = 0; g < CUBE_SIZE; g++)
+        {
+            for (int b = 0; b < CUBE_SIZE; b++)
+            {
+                short index = classify(palette, r * cell_width, g * cell_width, b * cell_width);
+                for (int corner = 1; corner < 8 && index != MIXED_CELL; corner++)
+                {
+                    int red = r * cell_width + (corner & 1 ? cell_width - 1 : 0);
+                    int green = g * cell_width + (corner & 2 ? cell_width - 1 : 0);
+                    int blue = b * cell_width + (corner & 4 ? cell_width - 1 : 0);
+                    if (classify(palette, red, green, blue) != index)
+                    {
+                        index = MIXED_CELL;
+                    }
+                }
+                cube.nearest[(r * CUBE_SIZE + g) * CUBE_SIZE + b] = index;
+            }
+        }
+    }
+    return cube;
+}
+
+// Builds the color cube for a palette that maps each color to the nearest palette color
+// @param palette between 1 and MAX_PALETTE_COLORS colors
+// @return the color cube
+ColorCube build_color_cube(const vector<Pixel> &palette)
+{
+    return build_color_cube(palette, nearest_palette_index);
+}
+
+// helper function to find a color's palette color with the color cube
+// @return the palette index
+int cube_lookup(const ColorCube &cube, int red, int green, int blue)
+{
+    red = clamp_color(red);
+    green = clamp_color(green);
+    blue = clamp_color(blue);
+    int shift = 8 - CUBE_BITS;
+    int index = cube.nearest[((red >> shift) * CUBE_SIZE + (green >> shift)) * CUBE_SIZE + (blue >> shift)];
+    if (index == MIXED_CELL)
+    {
+        index = cube.classify(cube.palette, red, green, blue);
+    }
+    return index;
+}
+
+// Maps every pixel of an image to its nearest palette color
+// @param image  the input image
+// @param cube   the palette and its color cube
+// @param dither how to spread the mapping error, if at all
+// @return the image using only palette colors
+vector<vector<Pixel>> quantize_image(const vector<vector<Pixel>> &image, const ColorCube &cube, Dither dither)
+{
+    int num_rows = image.size();
+    int num_columns = image[0].size();
+    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
+
+    // 4x4 Bayer matrix for ordered dithering. The pattern's strength is roughly the spacing of
+    // the palette colors, taken as 256 divided by the cube root of the palette size
+    const int bayer[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+    int spread = 256 / cbrt((double)cube.palette.size());
+
+    // Floyd-Steinberg error carried to the current and next row, with one spare column each side
+    vector<Pixel> error(num_columns + 2, {0, 0, 0});
+    vector<Pixel> next_error(num_columns + 2, {0, 0, 0});
+
+    for (int row = 0; row < num_rows; row++)
+    {
+        for (int column = 0; column < num_columns; column++)
+        {
+            int red = image[row][column].red;
+            int green = image[row][column].green;
+            int blue = image[row][column].blue;
+
+            if (dither == DITHER_ORDERED)
+            {
+                int offset = (bayer[row % 4][column % 4] * 2 - 15) * spread / 32;
+                red = red + offset;
+                green = green + offset;
+                blue = blue + offset;
+            }
+            else if (dither == DITHER_FLOYD_STEINBERG)
+            {
+                // The carried error is stored in sixteenths
+                red = clamp_color(red + error[column + 1].red / 16);
+                green = clamp_color(green + error[column + 1].green / 16);
+                blue = clamp_color(blue + error[column + 1].blue / 16);
+            }
+
+            const Pixel &color = cube.palette[cube_lookup(cube, red, green, blue)];
+            new_image[row][column] = color;
+
+            if (dither == DITHER_FLOYD_STEINBERG)
+            {
+                int red_error = red - color.red;
+                int green_error = green - color.green;
+                int blue_error = blue - color.blue;
+
+                // 7/16 to the right, 3/16 below left, 5/16 below and 1/16 below right
+                error[column + 2].red += red_error * 7;
+                error[column + 2].green += green_error * 7;
+                error[column + 2].blue += blue_error * 7;
+                next_error[column].red += red_error * 3;
+                next_error[column].green += green_error * 3;
+                next_error[column].blue += blue_error * 3;
+                next_error[column + 1].red += red_error * 5;
+                next_error[column + 1].green += green_error * 5;
+                next_error[column + 1].blue += blue_error * 5;
+                next_error[column + 2].red += red_error;
+                next_error[column + 2].green += green_error;
+                next_error[column + 2].blue += blue_error;
+            }
+        }
+        error.swap(next_error);
+        fill(next_error.begin(), next_error.end(), Pixel{0, 0, 0});
+    }
+    return new_image;
+}
+
+// Process 1
+// Adds vignette effect to image (dark corners)
+vector<vector<Pixel>> process_1(const vector<vector<Pixel>> &image)
+{
+    double num_rows = image.size();
+    double num_columns = image[0].size();
+    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
+
+    for (int row = 0; row < num_rows; row++)
+    {
+        for (int column = 0; column < num_columns; column++)
+        {
+
+            double red = image[row][column].red;
+            double green = image[row][column].green;
+            double blue = image[row][column].blue;
+
+            double distance = sqrt(pow(column - (num_columns / 2.0), 2) + pow(row - (num_rows / 2.0), 2));
+            double scaling_factor = (num_rows - distance) / num_rows;
+
+            double new_red = red * scaling_factor;
+            double new_green = green * scaling_factor;
+            double new_blue = blue * scaling_factor;
+
+            new_image[row][column].red = new_red;
             new_image[row][column].green = new_green;
             new_image[row][column].blue = new_blue;
         }
     }
-    return new_image;
+    return new_image;
+}
+
+// Process 2
+// Adds Clarendon effect to image (darks darker and lights lighter) by a scaling factor)
+vector<vector<Pixel>> process_2(const vector<vector<Pixel>> &image, double scaling_factor)
+{
+    int num_rows = image.size();
+    int num_columns = image[0].size();
+    double average_value;
+    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
+
+    for (int row = 0; row < num_rows; row++)
+    {
+        for (int column = 0; column < num_columns; column++)
+        {
+
+            double red = image[row][column].red;
+            double green = image[row][column].green;
+            double blue = image[row][column].blue;
+
+            double new_red;
+            double new_green;
+            double new_blue;
+
+            average_value = (red + green + blue) / 3.0;
+
+            if (average_value >= 170)
+            {
+                new_red = (255 - (255 - red) * scaling_factor);
+                new_green = (255 - (255 - green) * scaling_factor);
+                new_blue = (255 - (255 - blue) * scaling_factor);
+            }
+
+            else if (average_value < 90)
+            {
+                new_red = red * scaling_factor;
+                new_green = green * scaling_factor;
+                new_blue = blue * scaling_factor;
+            }
+
+            else
+            {
+                new_red = red;
+                new_green = green;
+                new_blue = blue;
+            }
+
+            new_image[row][column].red = new_red;
+            new_image[row][column].green = new_green;
+            new_image[row][column].blue = new_blue;
+        }
+    }
+    return new_image;
+}
+
+// Process 3
+// Grayscale image, weighting red, green and blue by how bright they look (Rec. 601)
+vector<vector<Pixel>> process_3(const vector<vector<Pixel>> &image)
+{
+    return to_grayscale(image, REC_601);
+}
+
+// Process 4
+// Rotates image by 90 degrees clockwise (not counter-clockwise)
+vector<vector<Pixel>> process_4(const vector<vector<Pixel>> &image)
+{
+    int num_rows = image.size();
+    int num_columns = image[0].size();
+    vector<vector<Pixel>> new_image(num_columns, vector<Pixel>(num_rows));
+    for (int row = 0; row < num_rows; row++)
+    {
+        for (int column = 0; column < num_columns; column++)
+        {
+            double red = image[row][column].red;
+            double green = image[row][column].green;
+            double blue = image[row][column].blue;
+
+            new_image[column][num_rows - 1 - row].red = red;
+            new_image[column][num_rows - 1 - row].green = green;
+            new_image[column][num_rows - 1 - row].blue = blue;
+        }
+    }
+    return new_image;
+}
+
+// Process 5
+// Rotates image by a specified number of multiples of 90 degrees clockwise
+vector<vector<Pixel>> process_5(const vector<vector<Pixel>> &image, int number)
+{
+    vector<vector<Pixel>> new_image;
+    new_image = image;
+    if (number % 360 == 0)
+    {
+        new_image = image;
+    }
+    else if (number % 360 == 90)
+    {
+        new_image = process_4(image);
+    }
+    else if (number % 360 == 180)
+    {
+        new_image = process_4(process_4(image));
+    }
+    else
+    {
+        new_image = process_4(process_4(process_4(image)));
+    }
+    return new_image;
+}
+
+// Process 6
+// Enlarges image width and height by user entered factor
+vector<vector<Pixel>> process_6(const vector<vector<Pixel>> &image, int x_scale, int y_scale)
+{
+    int num_rows = image.size();
+    int num_columns = image[0].size();
+    int new_width = num_columns * x_scale;
+    int new_height = num_rows * y_scale;
+    vector<vector<Pixel>> new_image(new_height, vector<Pixel>(new_width));
+
+    for (int i = 0; i < new_height; i++)
+    {
+        for (int j = 0; j < new_width; j++)
+        {
+            new_image[i][j].red = image[int(i / y_scale)][int(j / x_scale)].red;
+            new_image[i][j].green = image[int(i / y_scale)][int(j / x_scale)].green;
+            new_image[i][j].blue = image[int(i / y_scale)][int(j / x_scale)].blue;
+        }
+    }
+    return new_image;
+}
+
+// Process 7
+// Convert image to high contrast (black and white only)
+vector<vector<Pixel>> process_7(const vector<vector<Pixel>> &image)
+{
+    int num_rows = image.size();
+    int num_columns = image[0].size();
+    int gray_value;
+    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
+    for (int row = 0; row < num_rows; row++)
+    {
+        for (int column = 0; column < num_columns; column++)
+        {
+            int red = image[row][column].red;
+            int green = image[row][column].green;
+            int blue = image[row][column].blue;
+
+            gray_value = (red + green + blue) / 3;
+
+            if (gray_value >= (255 / 2))
+            {
+                new_image[row][column].red = 255;
+                new_image[row][column].green = 255;
+                new_image[row][column].blue = 255;
+            }
+            else
+            {
+                new_image[row][column].red = 0;
+                new_image[row][column].green = 0;
+                new_image[row][column].blue = 0;
+            }
+        }
+    }
+    return new_image;
+}
+// Process 8
+// Lightens image by a scaling factor
+vector<vector<Pixel>> process_8(const vector<vector<Pixel>> &image, double scaling_factor)
+{
+
+    int num_rows = image.size();
+    int num_columns = image[0].size();
+    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
+    for (int row = 0; row < num_rows; row++)
+    {
+        for (int column = 0; column < num_columns; column++)
+        {
+            int red = image[row][column].red;
+            int green = image[row][column].green;
+            int blue = image[row][column].blue;
+
+            new_image[row][column].red = 255 - ((255 - red) * scaling_factor);
+            new_image[row][column].green = 255 - ((255 - green) * scaling_factor);
+            new_image[row][column].blue = 255 - ((255 - blue) * scaling_factor);
+        }
+    }
+    return new_image;
+}
+
+// Process 9
+// Darkens image by a scaling factor
+vector<vector<Pixel>> process_9(const vector<vector<Pixel>> &image, double scaling_factor)
+{
+    int num_rows = image.size();
+    int num_columns = image[0].size();
+    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
+    for (int row = 0; row < num_rows; row++)
+    {
+        for (int column = 0; column < num_columns; column++)
+        {
+            int red = image[row][column].red;
+            int green = image[row][column].green;
+            int blue = image[row][column].blue;
+
+            new_image[row][column].red = red * scaling_factor;
+            new_image[row][column].green = green * scaling_factor;
+            new_image[row][column].blue = blue * scaling_factor;
+        }
+    }
+    return new_image;
+}
+
+// Palette of process 10, in the order five_color_index picks from
+const vector<Pixel> FIVE_COLORS = {{0, 0, 0}, {255, 255, 255}, {255, 0, 0}, {0, 255, 0}, {0, 0, 255}};
+
+// helper function for process 10: very bright colors become white and very dark ones black,
+// anything else becomes its strongest channel (red, then green, then blue on a tie)
+// @return the index into FIVE_COLORS
+int five_color_index(const vector<Pixel> &, int red, int green, int blue)
+{
+    int sum = red + green + blue;
+    int max_rgb = max(red, max(green, blue));
+    if (sum >= 550)
+    {
+        return 1;
+    }
+    else if (sum <= 150)
+    {
+        return 0;
+    }
+    else if (max_rgb == red)
+    {
+        return 2;
+    }
+    else if (max_rgb == green)
+    {
+        return 3;
+    }
+    return 4;
+}
+
+// Process 10
+// Converts image to only black, white, red, blue, and green
+vector<vector<Pixel>> process_10(const vector<vector<Pixel>> &image)
+{
+    static const ColorCube five_colors = build_color_cube(FIVE_COLORS, five_color_index);
+    return quantize_image(image, five_colors, DITHER_NONE);
+}
+
+// Process 11
+// Converts image to only the colors of a user palette, optionally dithered
+vector<vector<Pixel>> process_11(const vector<vector<Pixel>> &image, const ColorCube &palette_cube, Dither dither)
+{
+    return quantize_image(image, palette_cube, dither);
+}
+
+// Process 12
+// Grayscale image using the HD video (Rec. 709) luminance weights
+vector<vector<Pixel>> process_12(const vector<vector<Pixel>> &image)
+{
+    return to_grayscale(image, REC_709);
+}
+
+// Filter selection and the values the user entered for it
+struct FilterSettings
+{
+    int selection;
+    double scaling_factor;
+    int num_degrees;
+    int x_factor;
+    int y_factor;
+    ColorCube palette_cube;
+    Dither dither;
+};
+
+// helper function to prompt the user for the values the selected filter needs
+// @param settings the selected filter; filled in with the values entered
+// @return false if a non-numeric value was entered
+bool get_filter_settings(FilterSettings &settings)
+{
+    switch (settings.selection)
+    {
+    case 2:
+        do
+        {
+            cout << "Please enter a scaling factor between 0 and 1.";
+            cout << endl;
+            cin >> settings.scaling_factor;
+            if (cin.fail())
+            {
+                cout << "Numeric value not entered. Program quitting.";
+                return false;
+            }
+        } while (settings.scaling_factor < 0 || settings.scaling_factor > 1);
+        break;
+    case 5:
+        do
+        {
+            cout << "Please enter number of degrees you wish to rotate (in multiples of 90 only).";
+            cout << endl;
+            cin >> settings.num_degrees;
+            if (cin.fail())
+            {
+                cout << "Numeric value not entered. Program quitting.";
+                return false;
+            }
+        } while (settings.num_degrees % 90 != 0);
+        break;
+    case 6:
+        cout << "Please enter factor by which to increase the width (integer values only).";
+        cout << endl;
+        cin >> settings.x_factor;
+        if (cin.fail())
+        {
+            cout << "Non-integer values not allowed. Program quitting.";
+            return false;
+        }
+        cout << "Please enter a factor by which to increase the height (integer values only).";
+        cout << endl;
+        cin >> settings.y_factor;
+        if (cin.fail())
+        {
+            cout << "Non-integer values not allowed. Program quitting.";
+            return false;
+        }
+        break;
+    case 8:
+        do
+        {
+            cout << "Please enter a factor by which to lighten the image (between 0 and 1).";
+            cout << endl;
+            cin >> settings.scaling_factor;
+            if (cin.fail())
+            {
+                cout << "Numeric value not entered. Program quitting.";
+                return false;
+            }
+        } while (settings.scaling_factor < 0 || settings.scaling_factor > 1);
+        break;
+    case 9:
+        do
+        {
+            cout << "Please enter a factor by which to darken the image (between 0 and 1).";
+            cout << endl;
+            cin >> settings.scaling_factor;
+            if (cin.fail())
+            {
+                cout << "Numeric value not entered. Program quitting.";
+                return false;
+            }
+        } while (settings.scaling_factor < 0 || settings.scaling_factor > 1);
+        break;
+    case 11:
+    {
+        int num_colors;
+        do
+        {
+            cout << "Please enter the number of colors in your palette (1 to " << MAX_PALETTE_COLORS << ").";
+            cout << endl;
+            cin >> num_colors;
+            if (cin.fail())
+            {
+                cout << "Non-integer values not allowed. Program quitting.";
+                return false;
+            }
+        } while (num_colors < 1 || num_colors > MAX_PALETTE_COLORS);
+
+        vector<Pixel> palette(num_colors);
+        for (int i = 0; i < num_colors; i++)
+        {
+            do
+            {
+                cout << "Please enter color " << i + 1;
+                cout << " as red, green and blue values between 0 and 255 (e.g. 255 128 0).";
+                cout << endl;
+                cin >> palette[i].red >> palette[i].green >> palette[i].blue;
+                if (cin.fail())
+                {
+                    cout << "Non-integer values not allowed. Program quitting.";
+                    return false;
+                }
+            } while (palette[i].red != clamp_color(palette[i].red) ||
+                     palette[i].green != clamp_color(palette[i].green) ||
+                     palette[i].blue != clamp_color(palette[i].blue));
+        }
+        settings.palette_cube = build_color_cube(palette);
+
+        int dither;
+        do
+        {
+            cout << "Please select a dithering method (0: none, 1: ordered, 2: Floyd-Steinberg).";
+            cout << endl;
+            cin >> dither;
+            if (cin.fail())
+            {
+                cout << "Non-integer values not allowed. Program quitting.";
+                return false;
+            }
+        } while (dither < DITHER_NONE || dither > DITHER_FLOYD_STEINBERG);
+        settings.dither = (Dither)dither;
+        break;
+    }
+    }
+    return true;
+}
+
+// helper function to run the selected filter on an image
+// @param image    the input image
+// @param settings the selected filter and its values
+// @return the filtered image
+vector<vector<Pixel>> apply_filter(const vector<vector<Pixel>> &image, const FilterSettings &settings)
+{
+    switch (settings.selection)
+    {
+    case 1:
+        return process_1(image);
+    case 2:
+        return process_2(image, settings.scaling_factor);
+    case 3:
+        return process_3(image);
+    case 4:
+        return process_4(image);
+    case 5:
+        return process_5(image, settings.num_degrees);
+    case 6:
+        return process_6(image, settings.x_factor, settings.y_factor);
+    case 7:
+        return process_7(image);
+    case 8:
+        return process_8(image, settings.scaling_factor);
+    case 9:
+        return process_9(image, settings.scaling_factor);
+    case 10:
+        return process_10(image);
+    case 11:
+        return process_11(image, settings.palette_cube, settings.dither);
+    case 12:
+        return process_12(image);
+    }
+    return image;
+}
+
+// Room for this many files between two pipeline stages (must be a power of two)
+const int BATCH_QUEUE_CAPACITY = 4;
+
+// Most images a batch holds in memory at once. Without a limit every reader, filter and writer
+// thread and every queue slot could each hold an image of up to MAX_IMAGE_PIXELS
+const int BATCH_MAX_IMAGES_IN_FLIGHT = 4;
+
+// Counts how many more images the batch may hold in memory. A reader takes a slot before
+// reading a file and the writer gives it back once the file has been written
+struct ImageSlots
+{
+    mutex slot_mutex;
+    condition_variable slot_freed;
+    int available;
+
+    ImageSlots(int count) : available(count)
+    {
+    }
+};
+
+// helper function to wait until another image may be read
+// @return true if the reader had to wait
+bool take_image_slot(ImageSlots &slots)
+{
+    unique_lock<mutex> lock(slots.slot_mutex);
+    bool waited = false;
+    while (slots.available == 0)
+    {
+        waited = true;
+        slots.slot_freed.wait(lock);
+    }
+    slots.available--;
+    return waited;
+}
+
+// helper function to return an image's slot once it is no longer held
+void give_back_image_slot(ImageSlots &slots)
+{
+    {
+        lock_guard<mutex> lock(slots.slot_mutex);
+        slots.available++;
+    }
+    slots.slot_freed.notify_one();
+}
+
+// One file moving through the batch pipeline
+struct BatchJob
+{
+    int index;
+    string input_filename;
+    string output_filename;
+    vector<vector<Pixel>> image;
+    bool read_ok;
+};
+
+// Slot in a JobQueue. The sequence number says whether the slot is ready to be filled or emptied
+struct QueueCell
+{
+    atomic<size_t> sequence;
+    BatchJob job;
+};
+
+// Bounded lock-free queue of jobs between two pipeline stages.
+// Any number of threads may push and pop; each claims a slot by advancing a position
+// with compare-and-swap, so no thread ever holds a lock while another waits.
+// The mutex and condition variables are only used by threads that have run out of work
+// and go to sleep until the queue changes (see wait_for_job() and wait_to_hand_off()).
+struct JobQueue
+{
+    vector<QueueCell> cells;
+    size_t mask;
+    atomic<size_t> push_position;
+    atomic<size_t> pop_position;
+    mutex sleep_mutex;
+    condition_variable not_empty;
+    condition_variable not_full;
+
+    JobQueue(int capacity) : cells(capacity), mask(capacity - 1), push_position(0), pop_position(0)
+    {
+        for (int i = 0; i < capacity; i++)
+        {
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+};
+
+// helper function to add a job to a queue
+// @return false (leaving the job untouched) if the queue is full
+bool queue_try_push(JobQueue &queue, BatchJob &job)
+{
+    size_t position = queue.push_position.load(memory_order_relaxed);
+    while (true)
+    {
+        QueueCell &cell = queue.cells[position & queue.mask];
+        size_t sequence = cell.sequence.load(memory_order_acquire);
+        long long difference = (long long)sequence - (long long)position;
+        if (difference == 0)
+        {
+            // The slot is empty; claim it unless another thread got there first
+            if (queue.push_position.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+            {
+                cell.job = move(job);
+                cell.sequence.store(position + 1, memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0)
+        {
+            // The slot still holds a job from the previous lap
+            return false;
+        }
+        else
+        {
+            position = queue.push_position.load(memory_order_relaxed);
+        }
+    }
+}
+
+// helper function to take the oldest job from a queue
+// @return false if the queue is empty
+bool queue_try_pop(JobQueue &queue, BatchJob &job)
+{
+    size_t position = queue.pop_position.load(memory_order_relaxed);
+    while (true)
+    {
+        QueueCell &cell = queue.cells[position & queue.mask];
+        size_t sequence = cell.sequence.load(memory_order_acquire);
+        long long difference = (long long)sequence - (long long)(position + 1);
+        if (difference == 0)
+        {
+            if (queue.pop_position.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+            {
+                job = move(cell.job);
+                cell.sequence.store(position + queue.mask + 1, memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0)
+        {
+            return false;
+        }
+        else
+        {
+            position = queue.pop_position.load(memory_order_relaxed);
+        }
+    }
+}
+
+// Timing totals for one pipeline stage, summed over its threads
+struct StageMetrics
+{
+    string name;
+    int thread_count;
+    atomic<int> claimed;          // Jobs claimed by the stage's threads so far
+    atomic<long long> busy_ns;    // Time spent reading, filtering or writing
+    atomic<long long> starved_ns; // Time spent waiting for the previous stage
+    atomic<long long> blocked_ns; // Time spent waiting for room in the next queue (backpressure)
+    atomic<int> blocked_count;    // Number of times the next queue was full
+
+    StageMetrics(string stage_name, int threads)
+        : name(stage_name), thread_count(threads), claimed(0), busy_ns(0), starved_ns(0), blocked_ns(0),
+          blocked_count(0)
+    {
+    }
+};
+
+// helper function to get the nanoseconds between two times
+long long elapsed_ns(chrono::steady_clock::time_point from, chrono::steady_clock::time_point to)
+{
+    return chrono::duration_cast<chrono::nanoseconds>(to - from).count();
+}
+
+// A thread that finds its queue empty or full retries this many times before going to sleep,
+// since the wait is often very short
+const int QUEUE_SPIN_TRIES = 64;
+
+// helper function to wake one thread sleeping on a queue condition
+// Taking the mutex first means a thread that has just found the queue empty or full
+// is either already asleep (and is woken) or will see the change before sleeping
+void wake_queue_sleeper(JobQueue &queue, condition_variable &condition)
+{
+    {
+        lock_guard<mutex> lock(queue.sleep_mutex);
+    }
+    condition.notify_one();
+}
+
+// helper function for the batch pipeline: waits for a job from the previous stage
+void wait_for_job(JobQueue &queue, BatchJob &job, long long &starved_ns)
+{
+    chrono::steady_clock::time_point wait_start = chrono::steady_clock::now();
+    bool popped = false;
+    for (int i = 0; i < QUEUE_SPIN_TRIES && !popped; i++)
+    {
+        popped = queue_try_pop(queue, job);
+    }
+    if (!popped)
+    {
+        unique_lock<mutex> lock(queue.sleep_mutex);
+        while (!queue_try_pop(queue, job))
+        {
+            queue.not_empty.wait(lock);
+        }
+    }
+    starved_ns = starved_ns + elapsed_ns(wait_start, chrono::steady_clock::now());
+
+    // There is room in the queue now
+    wake_queue_sleeper(queue, queue.not_full);
 }
 
-// Process 3
-// Grayscale image
-vector<vector<Pixel>> process_3(const vector<vector<Pixel>> &image)
+// helper function for the batch pipeline: waits for room in the next stage's queue
+void wait_to_hand_off(JobQueue &queue, BatchJob &job, long long &blocked_ns, int &blocked_count)
 {
-    int num_rows = image.size();
-    int num_columns = image[0].size();
-    double gray_value;
-    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
-    for (int row = 0; row < num_rows; row++)
+    if (!queue_try_push(queue, job))
     {
-        for (int column = 0; column < num_columns; column++)
+        blocked_count++;
+        chrono::steady_clock::time_point wait_start = chrono::steady_clock::now();
+        bool pushed = false;
+        for (int i = 0; i < QUEUE_SPIN_TRIES && !pushed; i++)
+        {
+            pushed = queue_try_push(queue, job);
+        }
+        if (!pushed)
         {
+            unique_lock<mutex> lock(queue.sleep_mutex);
+            while (!queue_try_push(queue, job))
+            {
+                queue.not_full.wait(lock);
+            }
+        }
+        blocked_ns = blocked_ns + elapsed_ns(wait_start, chrono::steady_clock::now());
+    }
 
-            double red = image[row][column].red;
-            double green = image[row][column].green;
-            double blue = image[row][column].blue;
+    // There is a job in the queue now
+    wake_queue_sleeper(queue, queue.not_empty);
+}
 
-            gray_value = (red + green + blue) / 3.0;
+// helper function to add one thread's timings to its stage
+void add_stage_metrics(StageMetrics &metrics, long long busy_ns, long long starved_ns, long long blocked_ns,
+                       int blocked_count)
+{
+    metrics.busy_ns += busy_ns;
+    metrics.starved_ns += starved_ns;
+    metrics.blocked_ns += blocked_ns;
+    metrics.blocked_count += blocked_count;
+}
 
-            new_image[row][column].red = gray_value;
-            new_image[row][column].green = gray_value;
-            new_image[row][column].blue = gray_value;
+// Batch pipeline read stage: reads files and hands them to the filter stage
+void read_stage(const vector<string> &input_filenames, const vector<string> &output_filenames, JobQueue &output,
+                ImageSlots &slots, StageMetrics &metrics)
+{
+    long long busy_ns = 0, starved_ns = 0, blocked_ns = 0;
+    int blocked_count = 0;
+    int total = input_filenames.size();
+    int index;
+    while ((index = metrics.claimed.fetch_add(1)) < total)
+    {
+        // Waiting for a slot means later stages still hold too many images, so it counts as blocked
+        chrono::steady_clock::time_point wait_start = chrono::steady_clock::now();
+        if (take_image_slot(slots))
+        {
+            blocked_count++;
+            blocked_ns = blocked_ns + elapsed_ns(wait_start, chrono::steady_clock::now());
         }
+
+        chrono::steady_clock::time_point work_start = chrono::steady_clock::now();
+        BatchJob job;
+        job.index = index;
+        job.input_filename = input_filenames[index];
+        job.output_filename = output_filenames[index];
+        // One I/O thread per file: the stage's own thread count is the parallelism the user chose
+        job.image = read_image_file(job.input_filename, 1);
+        job.read_ok = !job.image.empty();
+        busy_ns = busy_ns + elapsed_ns(work_start, chrono::steady_clock::now());
+
+        wait_to_hand_off(output, job, blocked_ns, blocked_count);
     }
-    return new_image;
+    add_stage_metrics(metrics, busy_ns, starved_ns, blocked_ns, blocked_count);
 }
 
-// Process 4
-// Rotates image by 90 degrees clockwise (not counter-clockwise)
-vector<vector<Pixel>> process_4(const vector<vector<Pixel>> &image)
+// Batch pipeline filter stage: filters images from the read stage and hands them to the write stage
+void filter_stage(int total, const FilterSettings &settings, JobQueue &input, JobQueue &output,
+                  StageMetrics &metrics)
 {
-    int num_rows = image.size();
-    int num_columns = image[0].size();
-    vector<vector<Pixel>> new_image(num_columns, vector<Pixel>(num_rows));
-    for (int row = 0; row < num_rows; row++)
+    long long busy_ns = 0, starved_ns = 0, blocked_ns = 0;
+    int blocked_count = 0;
+    while (metrics.claimed.fetch_add(1) < total)
     {
-        for (int column = 0; column < num_columns; column++)
-        {
-            double red = image[row][column].red;
-            double green = image[row][column].green;
-            double blue = image[row][column].blue;
+        BatchJob job;
+        wait_for_job(input, job, starved_ns);
 
-            new_image[column][num_rows - 1 - row].red = red;
-            new_image[column][num_rows - 1 - row].green = green;
-            new_image[column][num_rows - 1 - row].blue = blue;
+        chrono::steady_clock::time_point work_start = chrono::steady_clock::now();
+        if (job.read_ok)
+        {
+            job.image = apply_filter(job.image, settings);
         }
+        busy_ns = busy_ns + elapsed_ns(work_start, chrono::steady_clock::now());
+
+        wait_to_hand_off(output, job, blocked_ns, blocked_count);
     }
-    return new_image;
+    add_stage_metrics(metrics, busy_ns, starved_ns, blocked_ns, blocked_count);
 }
 
-// Process 5
-// Rotates image by a specified number of multiples of 90 degrees clockwise
-vector<vector<Pixel>> process_5(const vector<vector<Pixel>> &image, int number)
+// Batch pipeline write stage: writes the filtered images and records which files succeeded
+// Each entry of results is 0 if the file could not be read, 1 if it could not be written and 2 if it was written
+void write_stage(int total, JobQueue &input, vector<int> &results, ImageSlots &slots, StageMetrics &metrics)
 {
-    vector<vector<Pixel>> new_image;
-    new_image = image;
-    if (number % 360 == 0)
-    {
-        new_image = image;
-    }
-    else if (number % 360 == 90)
-    {
-        new_image = process_4(image);
-    }
-    else if (number % 360 == 180)
+    long long busy_ns = 0, starved_ns = 0, blocked_ns = 0;
+    int blocked_count = 0;
+    while (metrics.claimed.fetch_add(1) < total)
     {
-        new_image = process_4(process_4(image));
+        BatchJob job;
+        wait_for_job(input, job, starved_ns);
+
+        chrono::steady_clock::time_point work_start = chrono::steady_clock::now();
+        if (!job.read_ok)
+        {
+            results[job.index] = 0;
+        }
+        else if (write_image_file(job.output_filename, job.image, 1))
+        {
+            results[job.index] = 2;
+        }
+        else
+        {
+            results[job.index] = 1;
+        }
+        job.image.clear();
+        job.image.shrink_to_fit();
+        give_back_image_slot(slots);
+        busy_ns = busy_ns + elapsed_ns(work_start, chrono::steady_clock::now());
     }
-    else
+    add_stage_metrics(metrics, busy_ns, starved_ns, blocked_ns, blocked_count);
+}
+
+// helper function to strip a leading "./" so two spellings of the same file compare equal
+string normalize_filename(string filename)
+{
+    while (filename.size() > 2 && filename[0] == '.' && (filename[1] == '/' || filename[1] == '\\'))
     {
-        new_image = process_4(process_4(process_4(image)));
+        filename = filename.substr(2);
     }
-    return new_image;
+    return filename;
 }
 
-// Process 6
-// Enlarges image width and height by user entered factor
-vector<vector<Pixel>> process_6(const vector<vector<Pixel>> &image, int x_scale, int y_scale)
+// helper function to name the output files of a batch
+// Each output goes in the current directory, named prefix + the input's file name. Two inputs with
+// the same file name, or an output that would replace one of the inputs, would lose an image, so
+// such names get a number before the extension (altered_image_2.bmp) until they are unique.
+// An input whose extension is not a format this program writes gets .bmp added.
+// @param input_filenames  the files to process
+// @param prefix           the prefix for the output file names
+// @return one output file name per input file
+vector<string> get_batch_output_filenames(const vector<string> &input_filenames, const string &prefix)
 {
-    int num_rows = image.size();
-    int num_columns = image[0].size();
-    int new_width = num_columns * x_scale;
-    int new_height = num_rows * y_scale;
-    vector<vector<Pixel>> new_image(new_height, vector<Pixel>(new_width));
+    set<string> used_filenames;
+    for (size_t i = 0; i < input_filenames.size(); i++)
+    {
+        used_filenames.insert(normalize_filename(input_filenames[i]));
+    }
 
-    for (int i = 0; i < new_height; i++)
+    vector<string> output_filenames;
+    for (size_t i = 0; i < input_filenames.size(); i++)
     {
-        for (int j = 0; j < new_width; j++)
+        size_t slash = input_filenames[i].find_last_of("/\\");
+        string output_filename = prefix + input_filenames[i].substr(slash == string::npos ? 0 : slash + 1);
+        if (get_output_codec(output_filename) == nullptr)
         {
-            new_image[i][j].red = image[int(i / y_scale)][int(j / x_scale)].red;
-            new_image[i][j].green = image[int(i / y_scale)][int(j / x_scale)].green;
-            new_image[i][j].blue = image[int(i / y_scale)][int(j / x_scale)].blue;
+            output_filename = output_filename + ".bmp";
+            cout << "The altered image for " << input_filenames[i] << " will be saved as BMP because its "
+                 << "extension is not a format this program writes." << endl;
+        }
+        string candidate = output_filename;
+        size_t dot = output_filename.find_last_of('.');
+        if (dot == string::npos || output_filename.find_first_of("/\\", dot) != string::npos)
+        {
+            dot = output_filename.size();
+        }
+        for (int n = 2; used_filenames.count(normalize_filename(candidate)) > 0; n++)
+        {
+            candidate = output_filename.substr(0, dot) + "_" + to_string(n) + output_filename.substr(dot);
+        }
+        if (candidate != output_filename)
+        {
+            cout << "The altered image for " << input_filenames[i] << " will be named " << candidate
+                 << " so it does not replace another file in the batch." << endl;
         }
+        used_filenames.insert(normalize_filename(candidate));
+        output_filenames.push_back(candidate);
     }
-    return new_image;
+    return output_filenames;
 }
 
-// Process 7
-// Convert image to high contrast (black and white only)
-vector<vector<Pixel>> process_7(const vector<vector<Pixel>> &image)
+// Runs the selected filter over several files. Reading, filtering and writing run as separate
+// stages connected by bounded queues, so the next file is read while the current one is
+// filtered and the previous one written. A full queue makes the stage before it wait, and no more
+// than BATCH_MAX_IMAGES_IN_FLIGHT images are held in memory at once.
+// @param input_filenames  the files to process
+// @param prefix           output files are named prefix + input filename, in the current directory
+//                          (see get_batch_output_filenames())
+// @param settings         the selected filter and its values
+// @param read_threads     number of threads in the read stage
+// @param filter_threads   number of threads in the filter stage
+// @param write_threads    number of threads in the write stage
+// @return the number of files written
+int run_batch(const vector<string> &input_filenames, const string &prefix, const FilterSettings &settings,
+              int read_threads, int filter_threads, int write_threads)
 {
-    int num_rows = image.size();
-    int num_columns = image[0].size();
-    int gray_value;
-    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
-    for (int row = 0; row < num_rows; row++)
+    int total = input_filenames.size();
+    vector<string> output_filenames = get_batch_output_filenames(input_filenames, prefix);
+    JobQueue read_to_filter(BATCH_QUEUE_CAPACITY);
+    JobQueue filter_to_write(BATCH_QUEUE_CAPACITY);
+    ImageSlots slots(BATCH_MAX_IMAGES_IN_FLIGHT);
+    StageMetrics read_metrics("Read", read_threads);
+    StageMetrics filter_metrics("Filter", filter_threads);
+    StageMetrics write_metrics("Write", write_threads);
+    vector<int> results(total, 0);
+
+    chrono::steady_clock::time_point batch_start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int t = 0; t < read_threads; t++)
     {
-        for (int column = 0; column < num_columns; column++)
-        {
-            int red = image[row][column].red;
-            int green = image[row][column].green;
-            int blue = image[row][column].blue;
-
-            gray_value = (red + green + blue) / 3;
+        threads.push_back(thread(read_stage, cref(input_filenames), cref(output_filenames), ref(read_to_filter),
+                                 ref(slots), ref(read_metrics)));
+    }
+    for (int t = 0; t < filter_threads; t++)
+    {
+        threads.push_back(thread(filter_stage, total, cref(settings), ref(read_to_filter), ref(filter_to_write),
+                                 ref(filter_metrics)));
+    }
+    for (int t = 0; t < write_threads; t++)
+    {
+        threads.push_back(thread(write_stage, total, ref(filter_to_write), ref(results), ref(slots),
+                                 ref(write_metrics)));
+    }
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        threads[t].join();
+    }
+    long long batch_ns = elapsed_ns(batch_start, chrono::steady_clock::now());
 
-            if (gray_value >= (255 / 2))
-            {
-                new_image[row][column].red = 255;
-                new_image[row][column].green = 255;
-                new_image[row][column].blue = 255;
-            }
-            else
-            {
-                new_image[row][column].red = 0;
-                new_image[row][column].green = 0;
-                new_image[row][column].blue = 0;
-            }
+    int written = 0;
+    for (int i = 0; i < total; i++)
+    {
+        if (results[i] == 0)
+        {
+            cout << "Could not read " << input_filenames[i] << endl;
+        }
+        else if (results[i] == 1)
+        {
+            cout << "Could not write the altered image for " << input_filenames[i] << endl;
+        }
+        else
+        {
+            written++;
         }
     }
-    return new_image;
-}
-// Process 8
-// Lightens image by a scaling factor
-vector<vector<Pixel>> process_8(const vector<vector<Pixel>> &image, double scaling_factor)
-{
-
-    int num_rows = image.size();
-    int num_columns = image[0].size();
-    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
-    for (int row = 0; row < num_rows; row++)
+    cout << "Processed " << written << " of " << total << " files in " << fixed << setprecision(3)
+         << batch_ns / 1e9 << " seconds." << endl;
+
+    // Utilization is the share of each stage's thread time spent working. A stage that is often
+    // blocked is faster than the one after it; a stage that is often waiting is the faster one.
+    cout << left << setw(8) << "Stage" << right << setw(9) << "Threads" << setw(10) << "Busy (s)"
+         << setw(13) << "Waiting (s)" << setw(13) << "Blocked (s)" << setw(15) << "Times blocked"
+         << setw(13) << "Utilization" << endl;
+    StageMetrics *stages[] = {&read_metrics, &filter_metrics, &write_metrics};
+    for (int s = 0; s < 3; s++)
     {
-        for (int column = 0; column < num_columns; column++)
+        StageMetrics &metrics = *stages[s];
+        double utilization = 0;
+        if (batch_ns > 0)
         {
-            int red = image[row][column].red;
-            int green = image[row][column].green;
-            int blue = image[row][column].blue;
-
-            new_image[row][column].red = 255 - ((255 - red) * scaling_factor);
-            new_image[row][column].green = 255 - ((255 - green) * scaling_factor);
-            new_image[row][column].blue = 255 - ((255 - blue) * scaling_factor);
+            utilization = 100.0 * metrics.busy_ns / ((double)batch_ns * metrics.thread_count);
         }
+        cout << left << setw(8) << metrics.name << right << setw(9) << metrics.thread_count << setw(10)
+             << metrics.busy_ns / 1e9 << setw(13) << metrics.starved_ns / 1e9 << setw(13)
+             << metrics.blocked_ns / 1e9 << setw(15) << metrics.blocked_count << setw(12) << setprecision(1)
+             << utilization << "%" << setprecision(3) << endl;
     }
-    return new_image;
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+    return written;
 }
 
-// Process 9
-// Darkens image by a scaling factor
-vector<vector<Pixel>> process_9(const vector<vector<Pixel>> &image, double scaling_factor)
+// helper function to prompt the user for the files to process in batch mode
+vector<string> get_batch_filenames()
 {
-    int num_rows = image.size();
-    int num_columns = image[0].size();
-    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
-    for (int row = 0; row < num_rows; row++)
+    vector<string> filenames;
+    string filename;
+    cout << "Please enter the files to process, one at a time. Enter DONE when finished.";
+    cout << endl;
+    while (cin >> filename && filename != "DONE" && filename != "done")
     {
-        for (int column = 0; column < num_columns; column++)
-        {
-            int red = image[row][column].red;
-            int green = image[row][column].green;
-            int blue = image[row][column].blue;
-
-            new_image[row][column].red = red * scaling_factor;
-            new_image[row][column].green = green * scaling_factor;
-            new_image[row][column].blue = blue * scaling_factor;
-        }
+        filenames.push_back(filename);
     }
-    return new_image;
+    return filenames;
 }
 
-// Process 10
-// Converts image to only black, white, red, blue, and green
-vector<vector<Pixel>> process_10(const vector<vector<Pixel>> &image)
+// helper function to prompt the user for the number of threads in one batch stage
+// @return the number of threads, or 0 if a non-numeric value was entered
+int get_stage_threads(string stage)
 {
-    int num_rows = image.size();
-    int num_columns = image[0].size();
-    int max_rgb;
-    vector<vector<Pixel>> new_image(num_rows, vector<Pixel>(num_columns));
-    for (int row = 0; row < num_rows; row++)
+    int threads;
+    do
     {
-        for (int column = 0; column < num_columns; column++)
+        cout << "Please enter the number of threads to use for " << stage << " (1 or more).";
+        cout << endl;
+        cin >> threads;
+        if (cin.fail())
         {
-            int red = image[row][column].red;
-            int green = image[row][column].green;
-            int blue = image[row][column].blue;
-
-            max_rgb = max_int(red, green, blue);
-
-            if ((red + green + blue) >= 550)
-            {
-                new_image[row][column].red = 255;
-                new_image[row][column].green = 255;
-                new_image[row][column].blue = 255;
-            }
-            else if ((red + green + blue) <= 150)
-            {
-                new_image[row][column].red = 150;
-                new_image[row][column].green = 150;
-                new_image[row][column].blue = 150;
-            }
-            else if (max_rgb == red)
-            {
-                new_image[row][column].red = 255;
-                new_image[row][column].green = 0;
-                new_image[row][column].blue = 0;
-            }
-            else if (max_rgb == green)
-            {
-                new_image[row][column].red = 0;
-                new_image[row][column].green = 255;
-                new_image[row][column].blue = 0;
-            }
-            else if (max_rgb == blue)
-            {
-                new_image[row][column].red = 0;
-                new_image[row][column].green = 0;
-                new_image[row][column].blue = 255;
-            }
+            cout << "Numeric value not entered. Program quitting.";
+            return 0;
         }
-    }
-    return new_image;
+    } while (threads < 1);
+    return threads;
 }
 
+#ifndef IMAGE_MANIPULATOR_NO_MAIN
 int main()
 {
     bool CONTINUE = true;
@@ -621,135 +3059,68 @@ int main()
     {
         cout << "Hello and welcome to the CSPB1300 image manipulator!" << endl;
         string input_filename;
-        int selected_filter = 0;
+        FilterSettings settings;
+        settings.selection = 0;
         string output_filename;
         do
         {
-            if (selected_filter == 0)
+            if (settings.selection == 0)
             {
                 input_filename = get_input_filename();
             }
             cout << "Filename: ";
             cout << input_filename;
             cout << "\n";
-            selected_filter = get_selection();
-            if (selected_filter == -1)
+            settings.selection = get_selection();
+            if (settings.selection == -1)
             {
                 return 0;
             }
-        } while (selected_filter < 1 || selected_filter > 10);
+        } while (settings.selection < 1 || settings.selection > 12);
 
-        vector<vector<Pixel>> image_vector = read_image(input_filename);
-        vector<vector<Pixel>> new_image_vector;
-        switch (selected_filter)
+        if (!get_filter_settings(settings))
         {
-        case 1:
-            new_image_vector = process_1(image_vector);
-            break;
-
-        case 2:
-            double scaling_factor;
-            do
-            {
-                cout << "Please enter a scaling factor between 0 and 1.";
-                cout << endl;
-                cin >> scaling_factor;
-                if (cin.fail())
-                {
-                    cout << "Numeric value not entered. Program quitting.";
-                    return 1;
-                }
-            } while (scaling_factor < 0 || scaling_factor > 1);
-
-            new_image_vector = process_2(image_vector, scaling_factor);
-            break;
-        case 3:
-            new_image_vector = process_3(image_vector);
-            break;
-        case 4:
-            new_image_vector = process_4(image_vector);
-            break;
-        case 5:
-            int num_degrees;
-            do
-            {
-                cout << "Please enter number of degrees you wish to rotate (in multiples of 90 only).";
-                cout << endl;
-                cin >> num_degrees;
-                if (cin.fail())
-                {
-                    cout << "Numeric value not entered. Program quitting.";
-                    return 1;
-                }
-            } while (num_degrees % 90 != 0);
-
-            new_image_vector = process_5(image_vector, num_degrees);
-            break;
-        case 6:
-            int x_factor;
-            int y_factor;
+            return 1;
+        }
 
-            cout << "Please enter factor by which to increase the width (integer values only).";
+        if (input_filename == "BATCH" || input_filename == "batch")
+        {
+            vector<string> batch_filenames = get_batch_filenames();
+            string prefix;
+            cout << "Please enter a prefix for the altered images' filenames (e.g. altered_).";
             cout << endl;
-            cin >> x_factor;
-            if (cin.fail())
+            cin >> prefix;
+            int read_threads = get_stage_threads("reading files");
+            if (read_threads == 0)
             {
-                cout << "Non-integer values not allowed. Program quitting.";
                 return 1;
             }
-            cout << "Please enter a factor by which to increase the height (integer values only).";
-            cout << endl;
-            cin >> y_factor;
-            if (cin.fail())
+            int filter_threads = get_stage_threads("filtering images");
+            if (filter_threads == 0)
             {
-                cout << "Non-integer values not allowed. Program quitting.";
                 return 1;
             }
-            new_image_vector = process_6(image_vector, x_factor, y_factor);
-            break;
-
-        case 7:
-            new_image_vector = process_7(image_vector);
-            break;
-        case 8:
-            double scaling_factor_light;
-            do
-            {
-                cout << "Please enter a factor by which to lighten the image (between 0 and 1).";
-                cout << endl;
-                cin >> scaling_factor_light;
-                if (cin.fail())
-                {
-                    cout << "Numeric value not entered. Program quitting.";
-                    return 1;
-                }
-            } while (scaling_factor_light < 0 || scaling_factor_light > 1);
-
-            new_image_vector = process_8(image_vector, scaling_factor_light);
-            break;
-        case 9:
-            double scaling_factor_dark;
-            do
+            int write_threads = get_stage_threads("writing files");
+            if (write_threads == 0)
             {
-                cout << "Please enter a factor by which to darken the image (between 0 and 1).";
-                cout << endl;
-                cin >> scaling_factor_dark;
-                if (cin.fail())
-                {
-                    cout << "Numeric value not entered. Program quitting.";
-                    return 1;
-                }
-            } while (scaling_factor_dark < 0 || scaling_factor_dark > 1);
+                return 1;
+            }
+            run_batch(batch_filenames, prefix, settings, read_threads, filter_threads, write_threads);
+            continue;
+        }
 
-            new_image_vector = process_9(image_vector, scaling_factor_dark);
-            break;
-        case 10:
-            new_image_vector = process_10(image_vector);
-            break;
+        vector<vector<Pixel>> image_vector = read_image_file(input_filename);
+        if (image_vector.empty())
+        {
+            cout << input_filename;
+            cout << " could not be read as a valid image. Please try again.";
+            cout << endl;
+            continue;
         }
+        vector<vector<Pixel>> new_image_vector = apply_filter(image_vector, settings);
 
         output_filename = get_output_filename();
-        bool success = write_image(output_filename, new_image_vector);
+        bool success = write_image_file(output_filename, new_image_vector);
         if (success)
         {
             cout << "Please find your altered image named: ";
@@ -763,4 +3134,5 @@ int main()
         }
     }
     return 0;
-}
\ No newline at end of file
+}
+#endif